@@ -122,6 +122,22 @@ describe("async request", function ()
             assert.is_nil(response)
             assert.is_string(code)
         end)
+
+        it("should keep the body alive after the options are dropped", function ()
+            local easyhttp = require("easyhttp")
+            local json = require("dkjson")
+            local options = { method = "POST", body = string.rep("x", 1000000) }
+            local request = easyhttp.async_request("https://httpbin.org/post", options)
+            assert.truthy(request)
+            --[[@cast request easyhttp.AsyncRequest]]
+            options.body = nil
+            collectgarbage()
+            collectgarbage()
+
+            local response, code = request:response()
+            assert.are_equal(200, code)
+            assert.are_equal("1000000", json.decode(response --[[@as string]]).headers["Content-Length"])
+        end)
     end)
 
     describe("cancel", function ()
@@ -235,5 +251,131 @@ describe("async request", function ()
             assert.truthy(size_t == "number" or size_t == "nil")
         end)
     end)
-end)
 
+    describe("read", function ()
+        it("should return the whole body in pieces", function ()
+            local easyhttp = require("easyhttp")
+            local url = "https://httpbin.org/stream-bytes/65536?chunk_size=1024&seed=1"
+            local expected = easyhttp.request(url)
+            local request = easyhttp.async_request(url)
+            assert.truthy(request)
+            --[[@cast request easyhttp.AsyncRequest]]
+
+            local parts = {}
+            while true do
+                local chunk, err = request:read(4096)
+                assert.is_nil(err)
+                if not chunk then break end
+                assert.is_true(#chunk <= 4096)
+                parts[#parts + 1] = chunk
+            end
+            assert.are_equal(expected, table.concat(parts))
+            assert.are_equal("", (request:response()))
+        end)
+
+        it("should pause at max_buffered_bytes", function ()
+            local easyhttp = require("easyhttp")
+            local url = "https://httpbin.org/stream-bytes/262144?chunk_size=4096&seed=1"
+            local expected = easyhttp.request(url)
+            local request = easyhttp.async_request(url, { max_buffered_bytes = 32768 })
+            assert.truthy(request)
+            --[[@cast request easyhttp.AsyncRequest]]
+
+            local parts = {}
+            while true do
+                local _, buffered = request:data()
+                --one write from curl may go over the limit
+                assert.is_true(buffered <= 32768 + 16384)
+                local chunk, err = request:read(8192)
+                assert.is_nil(err)
+                if not chunk then break end
+                parts[#parts + 1] = chunk
+            end
+            assert.are_equal(expected, table.concat(parts))
+        end)
+
+        it("should fail past max_response_size", function ()
+            local easyhttp = require("easyhttp")
+            local request = easyhttp.async_request("https://httpbin.org/stream-bytes/65536", { max_response_size = 1024 })
+            assert.truthy(request)
+            --[[@cast request easyhttp.AsyncRequest]]
+            local response, err = request:response()
+            assert.is_nil(response)
+            assert.are_equal("response is larger than max_response_size", err)
+        end)
+
+        it("should return the error", function ()
+            local easyhttp = require("easyhttp")
+            local request = easyhttp.async_request("https://httpborg/get")
+            assert.truthy(request)
+            --[[@cast request easyhttp.AsyncRequest]]
+            request:response()
+            local chunk, err = request:read()
+            assert.is_nil(chunk)
+            assert.is_string(err)
+        end)
+    end)
+
+    describe("memory", function ()
+        it("should collect unreferenced requests as native memory grows", function ()
+            local easyhttp = require("easyhttp")
+            easyhttp.configure { memory_stats = true }
+            collectgarbage()
+            local baseline = easyhttp.memory_stats(true).current
+            for _ = 1, 100 do
+                local request = easyhttp.async_request("https://httpbin.org/bytes/102400", { response_body = "bytes" })
+                assert.truthy(request)
+                --[[@cast request easyhttp.AsyncRequest]]
+                request:response()
+            end
+            --without pacing every response would still be alive, about 10 MB
+            local peak = easyhttp.memory_stats().peak
+            easyhttp.configure { memory_stats = false }
+            assert.is_true(peak - baseline < 5 * 1024 * 1024)
+        end)
+
+        it("should hand bytes responses over to the value", function ()
+            local easyhttp = require("easyhttp")
+            local request = easyhttp.async_request("https://httpbin.org/bytes/4096", { response_body = "bytes" })
+            assert.truthy(request)
+            --[[@cast request easyhttp.AsyncRequest]]
+            local body = request:response()
+            assert.is_nil(request:read())
+            assert.is_nil(request:data())
+            assert.are_equal(4096, body:len())
+            assert.are_equal(body, request:response())
+        end)
+    end)
+
+    describe("concurrency", function ()
+        it("should queue requests over max_concurrency", function ()
+            local easyhttp = require("easyhttp")
+            easyhttp.configure { max_concurrency = 2 }
+            local requests = {}
+            for i = 1, 5 do
+                requests[i] = easyhttp.async_request("https://httpbin.org/get")
+                assert.truthy(requests[i])
+            end
+            for i = 1, 5 do
+                local response, code = requests[i]:response()
+                assert.truthy(response)
+                assert.are_equal(200, code)
+            end
+            easyhttp.configure { max_concurrency = 0 }
+        end)
+
+        it("should cancel a queued request", function ()
+            local easyhttp = require("easyhttp")
+            easyhttp.configure { max_concurrency = 1 }
+            local first = easyhttp.async_request("https://httpbin.org/delay/2")
+            local queued = easyhttp.async_request("https://httpbin.org/get")
+            assert.truthy(first and queued)
+            --[[@cast queued easyhttp.AsyncRequest]]
+            assert.is_truthy(queued:cancel())
+            local response, err = queued:response()
+            assert.is_nil(response)
+            assert.are_equal("request was cancelled", err)
+            easyhttp.configure { max_concurrency = 0 }
+        end)
+    end)
+end)
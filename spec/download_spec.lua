@@ -0,0 +1,92 @@
+-- Copyright (c) 2024 Amrit Bhogal
+--
+-- This software is released under the MIT License.
+-- https://opensource.org/licenses/MIT
+
+local function read_file(path)
+    local f = assert(io.open(path, "rb"))
+    local data = f:read("*a")
+    f:close()
+    return data
+end
+
+describe("download", function ()
+    it("should exist", function ()
+        local easyhttp = require("easyhttp")
+        assert.truthy(easyhttp.download)
+    end)
+
+    it("should be a function", function ()
+        local easyhttp = require("easyhttp")
+        assert.is_function(easyhttp.download)
+    end)
+
+    it("should download in parallel parts", function ()
+        local easyhttp = require("easyhttp")
+        local path = os.tmpname()
+        local ok, code, _, parts = easyhttp.download("https://httpbin.org/range/65536", path, { parts = 4, min_part_size = 16384 })
+        assert.is_true(ok)
+        assert.are_equal(200, code)
+        assert.are_equal(4, parts)
+
+        --httpbin's ranges repeat the alphabet, so misplaced parts show up
+        local data = read_file(path)
+        assert.are_equal(65536, #data)
+        assert.are_equal(string.rep("abcdefghijklmnopqrstuvwxyz", 2521):sub(1, 65536), data)
+        os.remove(path)
+    end)
+
+    it("should fall back to a single stream", function ()
+        local easyhttp = require("easyhttp")
+        local path = os.tmpname()
+        local ok, code, _, parts = easyhttp.download("https://httpbin.org/stream-bytes/4096", path, { parts = 8, min_part_size = 1024 })
+        assert.is_true(ok)
+        assert.are_equal(200, code)
+        assert.are_equal(1, parts)
+        assert.are_equal(4096, #read_file(path))
+        os.remove(path)
+    end)
+
+    it("should always download with GET", function ()
+        local easyhttp = require("easyhttp")
+        local path = os.tmpname()
+        --httpbin answers anything but GET on /get with a 405
+        local ok, code = easyhttp.download("https://httpbin.org/get", path, { method = "POST", body = "Hello, World!" })
+        assert.is_true(ok)
+        assert.are_equal(200, code)
+        os.remove(path)
+    end)
+
+    it("should resume a partial file", function ()
+        local easyhttp = require("easyhttp")
+        local path = os.tmpname()
+        local ok, code = easyhttp.download("https://httpbin.org/range/4096", path, { parts = 1 })
+        assert.is_true(ok)
+        local full = read_file(path)
+
+        local f = assert(io.open(path, "wb"))
+        f:write(full:sub(1, 1000))
+        f:close()
+
+        f = assert(io.open(path, "ab"))
+        ok, code = easyhttp.request("https://httpbin.org/range/4096", { output_file = f, resume = true })
+        f:close()
+        assert.is_true(ok)
+        assert.are_equal(206, code)
+        assert.are_equal(full, read_file(path))
+        os.remove(path)
+    end)
+
+    it("should return error for an unresolved domain", function ()
+        local easyhttp = require("easyhttp")
+        local ok, err = easyhttp.download("https://njfenjerfnooerfoiernobfoberfboeoibfreboreffrbijoburevbouev.com", os.tmpname())
+        assert.is_nil(ok)
+        assert.is_string(err)
+    end)
+
+    it("should reject fewer than 1 part", function ()
+        local easyhttp = require("easyhttp")
+        assert.has_error(function () easyhttp.download("https://httpbin.org/get", os.tmpname(), { parts = 0 }) end)
+        assert.has_error(function () easyhttp.download("https://httpbin.org/get", os.tmpname(), { min_part_size = 0 }) end)
+    end)
+end)
@@ -22,6 +22,79 @@ describe("_VERSION", function ()
     end)
 end)
 
+describe("configure", function ()
+    it("should exist", function ()
+        local easyhttp = require("easyhttp")
+        assert.is_function(easyhttp.configure)
+    end)
+
+    it("should reject negative limits", function ()
+        local easyhttp = require("easyhttp")
+        assert.has_error(function ()
+            easyhttp.configure { max_concurrency = -1 }
+        end)
+    end)
+end)
+
+describe("memory stats", function ()
+    it("should count request allocations", function ()
+        local easyhttp = require("easyhttp")
+        easyhttp.configure { memory_stats = true }
+        easyhttp.memory_stats(true)
+        --larger than a pooled buffer segment, so the body is always a new allocation
+        assert.truthy(easyhttp.request("https://httpbin.org/bytes/102400"))
+
+        local stats = easyhttp.memory_stats()
+        easyhttp.configure { memory_stats = false }
+        assert.is_true(stats.accounting)
+        assert.are_equal(1, stats.requests)
+        assert.is_true(stats.allocations > 0)
+        assert.is_true(stats.bytes_per_request > 0)
+        assert.is_true(stats.peak >= stats.current)
+    end)
+
+    it("should count nothing by default", function ()
+        local easyhttp = require("easyhttp")
+        easyhttp.memory_stats(true)
+        assert.truthy(easyhttp.request("https://httpbin.org/get"))
+
+        local stats = easyhttp.memory_stats()
+        assert.is_false(stats.accounting)
+        assert.are_equal(0, stats.requests)
+        assert.are_equal(0, stats.allocations)
+    end)
+
+    it("should only count libcurl if configured before the first request", function ()
+        local easyhttp = require("easyhttp")
+        assert.truthy(easyhttp.request("https://httpbin.org/get"))
+        assert.has_error(function ()
+            easyhttp.configure { count_libcurl = true }
+        end)
+    end)
+
+    it("should fail requests over the memory limit", function ()
+        local easyhttp = require("easyhttp")
+        easyhttp.configure { memory_limit = easyhttp.memory_stats().current + 64 * 1024 }
+        local response = easyhttp.request("https://httpbin.org/bytes/102400")
+        easyhttp.configure { memory_limit = 0 }
+
+        assert.is_nil(response)
+        assert.is_true(easyhttp.memory_stats().failed > 0)
+    end)
+end)
+
+describe("preconnect", function ()
+    it("should exist", function ()
+        local easyhttp = require("easyhttp")
+        assert.is_function(easyhttp.preconnect)
+    end)
+
+    it("should connect to each url", function ()
+        local easyhttp = require("easyhttp")
+        assert.are_equal(2, easyhttp.preconnect { "https://httpbin.org", "https://example.com" })
+    end)
+end)
+
 describe("request", function ()
     it("should exist", function ()
         local easyhttp = require("easyhttp")
@@ -91,6 +164,150 @@ describe("request", function ()
             assert.are_equal("easyhttp", data.headers["User-Agent"])
         end)
 
+        it("should allow choosing the http version", function ()
+            local easyhttp = require("easyhttp")
+            for _, version in ipairs { "1.1", "2" } do
+                local response, code = easyhttp.request("https://httpbin.org/get", {
+                    http_version = version
+                })
+                assert.truthy(response)
+                assert.are_equal(200, code)
+            end
+        end)
+
+        it("should reject an unknown http version", function ()
+            local easyhttp = require("easyhttp")
+            assert.has_error(function ()
+                easyhttp.request("https://httpbin.org/get", { http_version = "0.9" })
+            end)
+        end)
+
+        it("should use pinned addresses instead of DNS", function ()
+            local easyhttp = require("easyhttp")
+            local response, err = easyhttp.request("http://easyhttp.invalid:1/", {
+                resolve = {
+                    ["easyhttp.invalid:1"] = { "127.0.0.1" }
+                },
+                dns_cache_timeout = 0
+            })
+            assert.falsy(response)
+            --[[@cast err string]]
+            assert.truthy(err:find("connect"))
+        end)
+
+        it("should reject a malformed resolve table", function ()
+            local easyhttp = require("easyhttp")
+            assert.has_error(function ()
+                easyhttp.request("https://httpbin.org/get", { resolve = { "127.0.0.1" } })
+            end)
+        end)
+
+        it("should return the whole body regardless of expected_size", function ()
+            local easyhttp = require("easyhttp")
+            for _, size in ipairs { 1, 1024, 1024 * 1024 } do
+                local response, code = easyhttp.request("https://httpbin.org/bytes/4096", {
+                    expected_size = size
+                })
+                assert.are_equal(200, code)
+                assert.are_equal(4096, #response)
+            end
+        end)
+
+        it("should reassemble a chunked response spanning several segments", function ()
+            local easyhttp = require("easyhttp")
+            local response, code = easyhttp.request("https://httpbin.org/stream-bytes/102400?chunk_size=4096&seed=1")
+            assert.are_equal(200, code)
+            assert.are_equal(102400, #response)
+
+            local again = easyhttp.request("https://httpbin.org/stream-bytes/102400?chunk_size=4096&seed=1", {
+                expected_size = 1000
+            })
+            assert.are_equal(response, again)
+        end)
+
+        it("should return the body as bytes", function ()
+            local easyhttp = require("easyhttp")
+            local url = "https://httpbin.org/stream-bytes/102400?chunk_size=4096&seed=1"
+            local expected = easyhttp.request(url)
+            local body, code = easyhttp.request(url, { response_body = "bytes" })
+            assert.are_equal(200, code)
+            assert.are_equal("userdata", type(body))
+            --[[@cast body easyhttp.Bytes]]
+            assert.are_equal(#expected, #body)
+            assert.are_equal(expected, body:tostring())
+            assert.are_equal(expected:sub(4000, 5000), body:sub(4000, 5000))
+            assert.are_equal(expected:sub(-10), body:sub(-10))
+
+            local needle = expected:sub(4090, 4100)
+            assert.are_same({ expected:find(needle, 1, true) }, { body:find(needle) })
+        end)
+
+        it("should parse every response header", function ()
+            local easyhttp = require("easyhttp")
+            local query = {}
+            for i = 1, 40 do query[#query + 1] = ("X-Test-%d=%s"):format(i, ("v"):rep(i * 10)) end
+            local _, code, headers = easyhttp.request("https://httpbin.org/response-headers?" .. table.concat(query, "&"))
+            assert.are_equal(200, code)
+            --[[@cast headers { [string]: string }]]
+            for i = 1, 40 do
+                assert.are_equal(("v"):rep(i * 10), headers["X-Test-" .. i])
+            end
+        end)
+
+        it("should return the headers as an object", function ()
+            local easyhttp = require("easyhttp")
+            local _, code, headers = easyhttp.request("https://httpbin.org/response-headers?X-Test=a&X-Test=b", {
+                response_headers = "object"
+            })
+            assert.are_equal(200, code)
+            --[[@cast headers easyhttp.Headers]]
+            assert.are_equal("application/json", headers["content-type"])
+            assert.are_equal(headers["content-type"], headers["Content-Type"])
+            assert.are_same({ "a", "b" }, headers:get_all("x-test"))
+            assert.is_nil(headers["x-missing"])
+
+            local count = 0
+            for key, value in headers:pairs() do
+                assert.is_string(key)
+                assert.is_string(value)
+                count = count + 1
+            end
+            assert.are_equal(#headers, count)
+        end)
+
+        it("should decode compressed responses", function ()
+            local easyhttp = require("easyhttp")
+            local json = require("dkjson")
+            local response, code = easyhttp.request("https://httpbin.org/gzip", { compressed = true })
+            assert.are_equal(200, code)
+            local data = json.decode(response --[[@as string]])
+            assert.truthy(data)
+            assert.is_true(data.gzipped)
+
+            response, code = easyhttp.request("https://httpbin.org/gzip")
+            assert.are_equal(200, code)
+            assert.are_equal("\31\139", response:sub(1, 2))
+        end)
+
+        it("should fail past max_response_size", function ()
+            local easyhttp = require("easyhttp")
+            for _, url in ipairs { "https://httpbin.org/bytes/4096", "https://httpbin.org/stream-bytes/4096" } do
+                local response, err = easyhttp.request(url, { max_response_size = 1024 })
+                assert.is_nil(response)
+                --[[@cast err string]]
+                assert.truthy(err:find("max_response_size", 1, true))
+            end
+        end)
+
+        it("should reject negative sizes", function ()
+            local easyhttp = require("easyhttp")
+            for _, option in ipairs { "expected_size", "max_buffered_bytes", "max_response_size" } do
+                assert.has_error(function ()
+                    easyhttp.request("https://httpbin.org/get", { [option] = -1 })
+                end)
+            end
+        end)
+
         it("should return 404 for a non-existent page", function ()
             local easyhttp = require("easyhttp")
             local response, code, headers = easyhttp.request("https://httpbin.org/status/404")
@@ -172,6 +389,96 @@ describe("request", function ()
             --[[@cast data table]]
             assert.are_equal("Hello, World!", data.form.data)
         end)
+
+        it("should send binary bodies whole", function ()
+            local easyhttp = require("easyhttp")
+            local json = require("dkjson")
+            local response, code = easyhttp.request("https://httpbin.org/post", {
+                method = "POST",
+                headers = { ["Content-Type"] = "application/octet-stream" },
+                body = "a\0b\0c"
+            })
+            assert.are_equal(200, code)
+            local data = json.decode(response --[[@as string]])
+            assert.are_equal("5", data.headers["Content-Length"])
+        end)
+
+        it("should stream the body from a file", function ()
+            local easyhttp = require("easyhttp")
+            local json = require("dkjson")
+            local path = os.tmpname()
+            local f = assert(io.open(path, "wb"))
+            f:write(string.rep("x", 100000))
+            f:close()
+
+            local response, code = easyhttp.request("https://httpbin.org/post", { method = "POST", body_file = path })
+            assert.are_equal(200, code)
+            assert.are_equal("100000", json.decode(response --[[@as string]]).headers["Content-Length"])
+
+            f = assert(io.open(path, "rb"))
+            f:seek("set", 1000)
+            response, code = easyhttp.request("https://httpbin.org/post", { method = "POST", body = f })
+            f:close()
+            os.remove(path)
+            assert.are_equal(200, code)
+            assert.are_equal("99000", json.decode(response --[[@as string]]).headers["Content-Length"])
+        end)
+
+        it("should compress the body", function ()
+            local easyhttp = require("easyhttp")
+            local json = require("dkjson")
+            local response, code = easyhttp.request("https://httpbin.org/post", {
+                method = "POST",
+                body = string.rep("Hello, World!", 1000),
+                compress_body = "gzip"
+            })
+            assert.are_equal(200, code)
+            local data = json.decode(response --[[@as string]])
+            assert.are_equal("gzip", data.headers["Content-Encoding"])
+        end)
+
+        it("should send a multipart form", function ()
+            local easyhttp = require("easyhttp")
+            local json = require("dkjson")
+            local path = os.tmpname()
+            local f = assert(io.open(path, "wb"))
+            f:write("file contents")
+            f:close()
+
+            local response, code = easyhttp.request("https://httpbin.org/post", {
+                method = "POST",
+                form = {
+                    field = "value",
+                    upload = { path = path, type = "text/plain" },
+                }
+            })
+            os.remove(path)
+            assert.are_equal(200, code)
+            local data = json.decode(response --[[@as string]])
+            assert.are_equal("value", data.form.field)
+            assert.are_equal("file contents", data.files.upload)
+        end)
+
+        it("should stream the body from a function", function ()
+            local easyhttp = require("easyhttp")
+            local json = require("dkjson")
+            local pieces = { "Hello", ", ", "World!" }
+            --httpbin doesn't read chunked bodies, so the length is given up front
+            local response, code = easyhttp.request("https://httpbin.org/post", {
+                method = "POST",
+                body = function () return table.remove(pieces, 1) end,
+                body_length = #"Hello, World!"
+            })
+            assert.are_equal(200, code)
+            assert.are_equal("Hello, World!", json.decode(response --[[@as string]]).data)
+
+            local ok, err = easyhttp.request("https://httpbin.org/post", {
+                method = "POST",
+                body = function () error("no more data") end
+            })
+            assert.falsy(ok)
+            assert.truthy(err:find("no more data", 1, true))
+        end)
     end)
 
     it("should timeout", function ()
@@ -0,0 +1,93 @@
+-- Copyright (c) 2024 Amrit Bhogal
+--
+-- This software is released under the MIT License.
+-- https://opensource.org/licenses/MIT
+
+describe("multi request", function ()
+    it("should exist", function ()
+        local easyhttp = require("easyhttp")
+        assert.truthy(easyhttp.multi_request)
+    end)
+
+    it("should be a function", function ()
+        local easyhttp = require("easyhttp")
+        assert.is_function(easyhttp.multi_request)
+    end)
+
+    it("should return a request object", function ()
+        local easyhttp = require("easyhttp")
+        local multi = easyhttp.multi_request {
+            ["https://httpbin.org/get"] = {}
+        }
+        assert.truthy(multi)
+        --[[@cast multi easyhttp.MultiRequest]]
+        assert.are_equal(1, #multi)
+        assert.are_equal(0, multi:completed_requests())
+    end)
+
+    it("should return an error for callbacks which aren't functions", function ()
+        local easyhttp = require("easyhttp")
+        local multi, err = easyhttp.multi_request {
+            ["https://httpbin.org/get"] = { on_finish = "not a function" }
+        }
+        assert.is_nil(multi)
+        assert.are_equal("on_finish must be a function", err)
+    end)
+
+    describe("perform", function ()
+        it("should call on_finish for each request", function ()
+            local easyhttp = require("easyhttp")
+            local finished = {}
+            local multi = easyhttp.multi_request {
+                ["https://httpbin.org/get"] = {
+                    on_finish = function (response, code, headers)
+                        assert.is_string(response)
+                        assert.is_table(headers)
+                        finished.get = code
+                    end
+                },
+                ["https://httpbin.org/post"] = {
+                    method = "POST",
+                    body = "Hello, World!",
+                    on_finish = function (response, code)
+                        finished.post = code
+                    end
+                }
+            }
+            assert.truthy(multi)
+            --[[@cast multi easyhttp.MultiRequest]]
+            assert.are_equal(0, multi:perform())
+            assert.are_equal(2, multi:completed_requests())
+            assert.are_equal(200, finished.get)
+            assert.are_equal(200, finished.post)
+        end)
+
+        it("should call on_error for an unresolved domain", function ()
+            local easyhttp = require("easyhttp")
+            local error
+            local multi = easyhttp.multi_request {
+                ["https://njfenjerfnooerfoiernobfoberfboeoibfreboreffrbijoburevbouev.com"] = {
+                    on_error = function (err)
+                        error = err
+                    end
+                }
+            }
+            assert.truthy(multi)
+            --[[@cast multi easyhttp.MultiRequest]]
+            multi:perform()
+            assert.is_string(error)
+            assert.are_equal(1, multi:completed_requests())
+        end)
+
+        it("should return early on timeout", function ()
+            local easyhttp = require("easyhttp")
+            local multi = easyhttp.multi_request {
+                ["https://httpbin.org/delay/5"] = {}
+            }
+            assert.truthy(multi)
+            --[[@cast multi easyhttp.MultiRequest]]
+            assert.are_equal(1, multi:perform(0.5))
+            assert.are_equal(0, multi:completed_requests())
+        end)
+    end)
+end)
@@ -0,0 +1,105 @@
+-- Copyright (c) 2024 Amrit Bhogal
+--
+-- This software is released under the MIT License.
+-- https://opensource.org/licenses/MIT
+
+describe("session", function ()
+    it("should exist", function ()
+        local easyhttp = require("easyhttp")
+        assert.truthy(easyhttp.session)
+    end)
+
+    it("should be a function", function ()
+        local easyhttp = require("easyhttp")
+        assert.is_function(easyhttp.session)
+    end)
+
+    it("should return a session object", function ()
+        local easyhttp = require("easyhttp")
+        local session = easyhttp.session()
+        assert.truthy(session)
+        local tname = tostring(session)
+        if _VERSION == "Lua 5.4" then
+            assert.are_equal("easyhttp.Session", tname:sub(1, #"easyhttp.Session"))
+        else
+            assert.are_equal("userdata", tname:sub(1, #"userdata"))
+        end
+    end)
+
+    describe("request", function ()
+        it("should make a get request", function ()
+            local easyhttp = require("easyhttp")
+            local session = assert(easyhttp.session())
+            local response, code, headers = session:request("https://httpbin.org/get")
+            assert.is_string(response)
+            assert.are_equal(200, code)
+            assert.is_table(headers)
+        end)
+
+        it("should make several requests", function ()
+            local easyhttp = require("easyhttp")
+            local session = assert(easyhttp.session())
+            for _ = 1, 3 do
+                local response, code = session:request("https://httpbin.org/get")
+                assert.truthy(response)
+                assert.are_equal(200, code)
+            end
+        end)
+
+        it("should apply the default options", function ()
+            local easyhttp = require("easyhttp")
+            local json = require("dkjson")
+            local session = assert(easyhttp.session {
+                headers = {
+                    ["User-Agent"] = "easyhttp"
+                }
+            })
+            local response, code = session:request("https://httpbin.org/get", {
+                headers = {
+                    ["X-Test"] = "test"
+                }
+            })
+            assert.are_equal(200, code)
+
+            --[[@cast response string]]
+            local data = json.decode(response)
+            assert.truthy(data)
+            --[[@cast data table]]
+            assert.are_equal("easyhttp", data.headers["User-Agent"])
+            assert.are_equal("test", data.headers["X-Test"])
+        end)
+
+        it("should let request options override the defaults", function ()
+            local easyhttp = require("easyhttp")
+            local session = assert(easyhttp.session { method = "POST" })
+            local response, code = session:request("https://httpbin.org/get", { method = "GET" })
+            assert.truthy(response)
+            assert.are_equal(200, code)
+        end)
+
+        it("should return error for an unresolved domain", function ()
+            local easyhttp = require("easyhttp")
+            local session = assert(easyhttp.session())
+            local response, code = session:request("htp://www.example .com")
+            assert.falsy(response)
+            assert.is_string(code)
+        end)
+    end)
+
+    describe("warm", function ()
+        it("should connect to each url", function ()
+            local easyhttp = require("easyhttp")
+            local session = assert(easyhttp.session())
+            assert.are_equal(1, session:warm { "https://httpbin.org" })
+            local response, code = session:request("https://httpbin.org/get")
+            assert.truthy(response)
+            assert.are_equal(200, code)
+        end)
+
+        it("should not count unresolved domains", function ()
+            local easyhttp = require("easyhttp")
+            local session = assert(easyhttp.session())
+            assert.are_equal(0, session:warm({ "https://njfenjerfnooerfoiernobfoberfboeoibfreboreffrbijoburevbouev.com" }, 5))
+        end)
+    end)
+end)
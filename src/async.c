@@ -6,32 +6,41 @@
  */
 
 #include "async.h"
+#include "bytes.h"
+#include "config.h"
+#include "pool.h"
+#include "share.h"
 
 #include <stdlib.h>
 #include <string.h>
 
 #include <curl/curl.h>
 
-enum {
-    EASYHTTP_EXIT_CANCELLED = 0xA,
-    EASYHTTP_EXIT_ERROR = 0xB,
-};
+#define EASYHTTP_ASYNC_LOOP_TNAME "easyhttp.AsyncLoop"
 
-static int handle_error(struct easyhttp_AsyncRequest *request, const char *error)
-{
-    mtx_lock(&request->mutex);
-    {
-        if (request->cancelled) {
-            mtx_unlock(&request->mutex);
-            return 1;
-        }
+//A single background thread drives every async request through one multi handle
+static struct {
+    bool ok;
+    mtx_t mutex;
 
-        request->error = error;
-        request->cancelled = true;
-    }
-    mtx_unlock(&request->mutex);
-    return EASYHTTP_EXIT_ERROR;
-}
+    size_t users;
+    bool running, stopping, cancel_requested, resume_requested, reconfigure;
+    thrd_t thread;
+    CURLM *multi;
+
+    //submitted by the Lua side, admitted into `multi` by the loop thread in FIFO order
+    struct easyhttp_AsyncRequest *pending_head, *pending_tail;
+
+    //only touched by the loop thread
+    struct easyhttp_AsyncRequest *active;
+    size_t active_count;
+    struct easyhttp_Config config;
+} loop;
+
+static once_flag loop_once = ONCE_FLAG_INIT;
+
+static void loop_init(void)
+{ loop.ok = mtx_init(&loop.mutex, mtx_plain) == thrd_success; }
 
 static const char *thread_error_message(int i)
 {
@@ -53,16 +62,35 @@ static const char *thread_error_message(int i)
     return error_reason;
 }
 
-static int buffer_write(void *ptr, size_t size, size_t nmemb, void *userp)
+static size_t buffer_write(void *ptr, size_t size, size_t nmemb, void *userp)
 {
     struct easyhttp_AsyncRequest *request = userp; //to check `cancel` flag
-    if (request->cancelled) {
-        thrd_exit(EASYHTTP_EXIT_CANCELLED);
+    if (request->cancelled)
         return 0;
-    }
+
+    const struct easyhttp_Options *options = &request->request.options;
+    size_t length = size * nmemb;
 
     mtx_lock(&request->mutex);
-    int ret = easyhttp_buffer_write(ptr, size, nmemb, &request->request.response);
+    if (options->max_response_size > 0 && request->request.received + length > options->max_response_size) {
+        request->error = "response is larger than max_response_size";
+        mtx_unlock(&request->mutex);
+        return 0;
+    }
+
+    //an empty buffer always takes the write, so a limit below curl's write size can't stall the transfer
+    struct easyhttp_Buffer *response = request->request.response;
+    if (options->max_buffered_bytes > 0 && !request->unlimited
+        && response->length > 0 && response->length + length > options->max_buffered_bytes) {
+        //curl hands the same data over again once the transfer is unpaused
+        request->paused = true;
+        mtx_unlock(&request->mutex);
+        return CURL_WRITEFUNC_PAUSE;
+    }
+
+    //segments never move, so this only holds the lock for the copy (and the odd segment allocation)
+    size_t ret = easyhttp_buffer_write(ptr, size, nmemb, response);
+    request->request.received += ret;
     mtx_unlock(&request->mutex);
     return ret;
 }
@@ -70,49 +98,27 @@ static int buffer_write(void *ptr, size_t size, size_t nmemb, void *userp)
 static size_t header_write(char *buf, size_t size, size_t nmemb, void *userp)
 {
     struct easyhttp_AsyncRequest *request = userp; //to check `cancel` flag
-    if (request->cancelled) {
-        thrd_exit(EASYHTTP_EXIT_CANCELLED);
+    if (request->cancelled)
         return 0;
-    }
-
-    char *header = string_duplicate_n(buf, size * nmemb);
-    if (!header) {
-        return handle_error(request, "failed to allocate memory for header"), 0;
-    }
 
     mtx_lock(&request->mutex);
-    char *colon = strchr(header, ':');
-    if (!colon) {
-        free(header);
-        mtx_unlock(&request->mutex);
-        return size * nmemb;
-    }
-
-    *colon = '\0';
-    char *value = colon + 1;
-    while (*value == ' ' || *value == '\t') value++;
-    //set last char to null to ignore trailing newlines
-    char *end = value + strlen(value) - 1;
-    while (*end == '\n' || *end == '\r') *end-- = '\0';
-
-    request->request.headers = easyhttp_headers_append(request->request.headers, header, value);
-    if (!request->request.headers || !request->request.headers->headers[request->request.headers->length - 1].key || !request->request.headers->headers[request->request.headers->length - 1].value) {
-        free(header);
-        mtx_unlock(&request->mutex);
-        return handle_error(request, "failed to allocate memory for header kv pairs"), 0;
-    }
-
+    //with a limit, at most that much is ever buffered
+    if (request->request.options.max_buffered_bytes == 0)
+        easyhttp_buffer_presize(request->request.response, buf, size * nmemb);
+    size_t ret = easyhttp_headers_write(buf, size, nmemb, request->request.headers);
+    if (ret != size * nmemb)
+        request->error = "failed to allocate memory for header kv pairs";
     mtx_unlock(&request->mutex);
-    return size * nmemb;
+    return ret;
 }
 
-static int progress_callback(struct easyhttp_AsyncRequest *data, double dltotal, double dlnow, double ultotal, double ulnow)
+static int progress_callback(void *userp, double dltotal, double dlnow, double ultotal, double ulnow)
 {
+    struct easyhttp_AsyncRequest *data = userp;
     mtx_lock(&data->mutex);
     if (data->cancelled) {
         mtx_unlock(&data->mutex);
-        thrd_exit(EASYHTTP_EXIT_CANCELLED);
-        return 0;
+        return 1;
     }
 
     data->request.progress.dlnow = dlnow;
@@ -124,57 +130,381 @@ static int progress_callback(struct easyhttp_AsyncRequest *data, double dltotal,
     return 0;
 }
 
-static int easyhttp_thread_func(void *ptr)
+#pragma region Event loop
+
+static void active_add(struct easyhttp_AsyncRequest *request)
+{
+    request->prev = NULL;
+    request->next = loop.active;
+    if (loop.active) loop.active->prev = request;
+    loop.active = request;
+    loop.active_count++;
+}
+
+static void active_remove(struct easyhttp_AsyncRequest *request)
 {
-    struct easyhttp_AsyncRequest *req = ptr;
-    req->request.response = easyhttp_buffer_create();
-    if (!req->request.response) {
-        return handle_error(req, "failed to allocate memory for response");
+    if (request->prev) request->prev->next = request->next;
+    else loop.active = request->next;
+    if (request->next) request->next->prev = request->prev;
+    request->prev = request->next = NULL;
+    loop.active_count--;
+}
+
+//Hands the request back to the Lua side, which may free it as soon as `finished` is set
+static void loop_finish(struct easyhttp_AsyncRequest *request, CURLcode result)
+{
+    //curl tolerates removing handles which were never added
+    curl_multi_remove_handle(loop.multi, request->handle);
+
+    mtx_lock(&request->mutex);
+    {
+        if (request->cancelled) {
+            request->error = "request was cancelled";
+        } else if (result != CURLE_OK) {
+            //callbacks which abort the transfer (e.g. failed header allocations) leave a more specific message
+            if (!request->error)
+                request->error = easyhttp_upload_error(&request->request.upload);
+            if (!request->error)
+                request->error = result == CURLE_FILESIZE_EXCEEDED
+                    ? "response is larger than max_response_size"
+                    : curl_easy_strerror(result);
+        } else {
+            curl_easy_getinfo(request->handle, CURLINFO_RESPONSE_CODE, &request->request.response_code);
+            request->done = true;
+        }
+
+        easyhttp_pool_handle_release(request->handle);
+        request->handle = NULL;
+
+        request->finished = true;
+        cnd_broadcast(&request->finished_cond);
     }
+    mtx_unlock(&request->mutex);
+}
 
-    CURL *curl = curl_easy_init();
-    if (!curl) {
-        return handle_error(req, "failed to create curl handle");
+static void loop_apply_config(void)
+{
+    loop.config = easyhttp_config_get();
+    easyhttp_config_apply(&loop.config, loop.multi);
+}
+
+//Must be called with `loop.mutex` held, takes cancelled requests out of the pending queue
+static struct easyhttp_AsyncRequest *pending_take_cancelled(bool all)
+{
+    struct easyhttp_AsyncRequest *taken = NULL, *prev = NULL;
+    for (struct easyhttp_AsyncRequest *request = loop.pending_head, *next; request; request = next) {
+        next = request->next;
+        if (!all && !request->cancelled) {
+            prev = request;
+            continue;
+        }
+
+        if (prev) prev->next = next;
+        else loop.pending_head = next;
+        if (loop.pending_tail == request) loop.pending_tail = prev;
+
+        request->next = taken;
+        taken = request;
+    }
+    return taken;
+}
+
+//Must be called with `loop.mutex` held
+static struct easyhttp_AsyncRequest *pending_take_admitted(void)
+{
+    struct easyhttp_AsyncRequest *taken = NULL, **tail = &taken;
+    size_t count = loop.active_count;
+    while (loop.pending_head && (loop.config.max_concurrency <= 0 || count < (size_t)loop.config.max_concurrency)) {
+        struct easyhttp_AsyncRequest *request = loop.pending_head;
+        loop.pending_head = request->next;
+        if (!loop.pending_head) loop.pending_tail = NULL;
+
+        request->next = NULL;
+        *tail = request;
+        tail = &request->next;
+        count++;
     }
+    return taken;
+}
 
-    easyhttp_options_set(req->request.options, curl);
+static int loop_thread(void *arg)
+{
+    (void)arg;
+    loop_apply_config();
+
+    for (;;) {
+        mtx_lock(&loop.mutex);
+        bool stopping = loop.stopping;
+        bool scan = loop.cancel_requested || stopping;
+        bool resume = loop.resume_requested && !stopping;
+        loop.cancel_requested = loop.resume_requested = false;
+
+        if (loop.reconfigure) {
+            loop.reconfigure = false;
+            loop_apply_config();
+        }
 
-    curl_easy_setopt(curl, CURLOPT_URL, req->request.url);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, buffer_write);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, req);
-    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_write);
-    curl_easy_setopt(curl, CURLOPT_HEADERDATA, req);
-    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0);
-    curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, progress_callback);
-    curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, req);
+        struct easyhttp_AsyncRequest *cancelled = scan ? pending_take_cancelled(stopping) : NULL;
+        struct easyhttp_AsyncRequest *admitted = stopping ? NULL : pending_take_admitted();
+        mtx_unlock(&loop.mutex);
+
+        while (cancelled) {
+            struct easyhttp_AsyncRequest *request = cancelled;
+            cancelled = request->next;
+            request->next = NULL;
+            request->cancelled = true;
+            loop_finish(request, CURLE_ABORTED_BY_CALLBACK);
+        }
+
+        while (admitted) {
+            struct easyhttp_AsyncRequest *request = admitted;
+            admitted = request->next;
+            active_add(request);
+
+            if (curl_multi_add_handle(loop.multi, request->handle) != CURLM_OK) {
+                mtx_lock(&request->mutex);
+                request->error = "failed to add request to the event loop";
+                mtx_unlock(&request->mutex);
+                active_remove(request);
+                loop_finish(request, CURLE_FAILED_INIT);
+            }
+        }
+
+        if (scan) {
+            for (struct easyhttp_AsyncRequest *request = loop.active, *next; request; request = next) {
+                next = request->next;
+                if (stopping)
+                    request->cancelled = true;
+                if (request->cancelled) {
+                    active_remove(request);
+                    loop_finish(request, CURLE_ABORTED_BY_CALLBACK);
+                }
+            }
+        }
+
+        if (stopping)
+            break;
+
+        if (resume) {
+            for (struct easyhttp_AsyncRequest *request = loop.active; request; request = request->next) {
+                mtx_lock(&request->mutex);
+                bool unpause = request->resume;
+                request->resume = false;
+                mtx_unlock(&request->mutex);
+
+                //may call the write callback straight away, which takes the request's lock
+                if (unpause)
+                    curl_easy_pause(request->handle, CURLPAUSE_CONT);
+            }
+        }
+
+        int running = 0;
+        curl_multi_perform(loop.multi, &running);
+
+        bool freed = false;
+        CURLMsg *msg = NULL;
+        int queued = 0;
+        while ((msg = curl_multi_info_read(loop.multi, &queued))) {
+            if (msg->msg != CURLMSG_DONE) continue;
+
+            struct easyhttp_AsyncRequest *request = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&request);
+            active_remove(request);
+            loop_finish(request, msg->data.result);
+            freed = true;
+        }
 
-    req->request.headers = easyhttp_headers_create();
-    if (!req->request.headers) {
-        return handle_error(req, "failed to allocate memory for headers");
+        //a slot was freed, admit waiting requests straight away instead of sleeping
+        if (freed) {
+            mtx_lock(&loop.mutex);
+            bool waiting = loop.pending_head != NULL;
+            mtx_unlock(&loop.mutex);
+            if (waiting)
+                continue;
+        }
+
+        curl_multi_poll(loop.multi, NULL, 0, 1000, NULL);
     }
 
+    return 0;
+}
+
+//Must be called with `loop.mutex` held
+static const char *loop_start(void)
+{
+    if (loop.running)
+        return NULL;
+
+    loop.multi = curl_multi_init();
+    if (!loop.multi)
+        return "failed to create multi handle";
 
-    CURLcode res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-        return handle_error(req, curl_easy_strerror(res));
+    int i = thrd_create(&loop.thread, loop_thread, NULL);
+    if (i != thrd_success) {
+        curl_multi_cleanup(loop.multi);
+        loop.multi = NULL;
+        return thread_error_message(i);
     }
 
-    mtx_lock(&req->mutex);
-    {
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &req->request.response_code);
-        req->done = true;
+    loop.running = true;
+    return NULL;
+}
+
+//Must be called without `loop.mutex` held
+static void loop_stop(void)
+{
+    mtx_lock(&loop.mutex);
+    if (!loop.running) {
+        mtx_unlock(&loop.mutex);
+        return;
+    }
+    loop.stopping = true;
+    mtx_unlock(&loop.mutex);
+
+    curl_multi_wakeup(loop.multi);
+    thrd_join(loop.thread, NULL);
+
+    mtx_lock(&loop.mutex);
+    curl_multi_cleanup(loop.multi);
+    loop.multi = NULL;
+    loop.running = loop.stopping = false;
+    mtx_unlock(&loop.mutex);
+}
+
+static const char *loop_submit(struct easyhttp_AsyncRequest *request)
+{
+    mtx_lock(&loop.mutex);
+    const char *err = loop_start();
+    if (err) {
+        mtx_unlock(&loop.mutex);
+        return err;
+    }
+
+    request->queued = true;
+    request->next = NULL;
+    if (loop.pending_tail) loop.pending_tail->next = request;
+    else loop.pending_head = request;
+    loop.pending_tail = request;
+    mtx_unlock(&loop.mutex);
+
+    curl_multi_wakeup(loop.multi);
+    return NULL;
+}
+
+static void loop_cancel(struct easyhttp_AsyncRequest *request)
+{
+    request->cancelled = true;
+
+    mtx_lock(&loop.mutex);
+    loop.cancel_requested = true;
+    CURLM *multi = loop.running ? loop.multi : NULL;
+    mtx_unlock(&loop.mutex);
+
+    if (multi)
+        curl_multi_wakeup(multi);
+}
+
+//Must be called with `request->mutex` held
+static void loop_resume(struct easyhttp_AsyncRequest *request)
+{
+    if (!request->paused)
+        return;
+    request->paused = false;
+    request->resume = true;
+
+    mtx_lock(&loop.mutex);
+    loop.resume_requested = true;
+    CURLM *multi = loop.running ? loop.multi : NULL;
+    mtx_unlock(&loop.mutex);
+
+    if (multi)
+        curl_multi_wakeup(multi);
+}
+
+void easyhttp_async_reconfigure(void)
+{
+    call_once(&loop_once, loop_init);
+    if (!loop.ok) return;
+
+    mtx_lock(&loop.mutex);
+    loop.reconfigure = true;
+    CURLM *multi = loop.running ? loop.multi : NULL;
+    mtx_unlock(&loop.mutex);
+
+    if (multi)
+        curl_multi_wakeup(multi);
+}
+
+static int loop__gc(lua_State *L)
+{
+    (void)L;
+
+    mtx_lock(&loop.mutex);
+    bool last = --loop.users == 0;
+    mtx_unlock(&loop.mutex);
+
+    //the thread runs code from this library, so it has to be gone before the library is unloaded.
+    //libcurl goes too, so it holds no pointers into the library (and can be initialised again by the next state)
+    if (last) {
+        loop_stop();
+        easyhttp_pool_handle_drain();
+        easyhttp_share_global_destroy();
+        easyhttp_memory_curl_cleanup();
     }
-    mtx_unlock(&req->mutex);
     return 0;
 }
 
+void easyhttp_async_open(lua_State *L)
+{
+    call_once(&loop_once, loop_init);
+    if (!loop.ok) {
+        luaL_error(L, "failed to create event loop mutex");
+        return;
+    }
+
+    mtx_lock(&loop.mutex);
+    loop.users++;
+    mtx_unlock(&loop.mutex);
+
+    //closing the state collects this sentinel before the library itself is unloaded
+    lua_newuserdata(L, 1);
+    luaL_newmetatable(L, EASYHTTP_ASYNC_LOOP_TNAME);
+    lua_pushcfunction(L, loop__gc);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+#pragma endregion
+
 int easyhttp_async_request(lua_State *L)
 {
+    easyhttp_memory_curl_check(L);
+    const char *url = luaL_checkstring(L, 1);
+    if (lua_isnoneornil(L, 2)) {
+        lua_settop(L, 1);
+        lua_newtable(L);
+    } else {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lua_settop(L, 2);
+    }
+
     struct easyhttp_AsyncRequest *request = lua_newuserdata(L, sizeof(struct easyhttp_AsyncRequest));
-    *request = (struct easyhttp_AsyncRequest) {0};
+    *request = (struct easyhttp_AsyncRequest) { .anchor = LUA_NOREF };
     luaL_setmetatable(L, EASYHTTP_ASYNC_REQUEST_TNAME);
 
-    request->request.url = luaL_checkstring(L, 1);
+    //the options table may be changed or dropped while the request is running, so the values themselves are pinned
+    lua_createtable(L, 2, 0);
+    lua_pushvalue(L, 1);
+    lua_rawseti(L, -2, 1);
+    lua_getfield(L, 2, "body");
+    lua_rawseti(L, -2, 2);
+    request->anchor = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    request->request.url = url;
+    easyhttp_memory_count_request();
+    //earlier requests may still hold large responses which only their finalizers free
+    easyhttp_memory_pace_gc(L);
 
     const char *err = NULL;
     request->request.options = easyhttp_options_parse(L, 2, &err);
@@ -184,17 +514,71 @@ int easyhttp_async_request(lua_State *L)
         return 2;
     }
 
-    int i = mtx_init(&request->mutex, mtx_plain);
-    if (i != thrd_success) {
+    if (mtx_init(&request->mutex, mtx_plain) != thrd_success) {
         lua_pushnil(L);
         lua_pushliteral(L, "failed to create mutex");
         return 2;
     }
+    if (cnd_init(&request->finished_cond) != thrd_success) {
+        mtx_destroy(&request->mutex);
+        lua_pushnil(L);
+        lua_pushliteral(L, "failed to create condition variable");
+        return 2;
+    }
+    request->initialized = true;
 
-    i = thrd_create(&request->thread, easyhttp_thread_func, request);
-    if (i != thrd_success) {
+    request->request.response = easyhttp_buffer_create();
+    request->request.headers = easyhttp_headers_create();
+    if (!request->request.response || !request->request.headers) {
+        lua_pushnil(L);
+        lua_pushliteral(L, "failed to allocate memory for response");
+        return 2;
+    }
+    size_t reserve = request->request.options.expected_size;
+    if (request->request.options.max_buffered_bytes > 0 && reserve > request->request.options.max_buffered_bytes)
+        reserve = request->request.options.max_buffered_bytes;
+    if (reserve > 0)
+        easyhttp_buffer_reserve(request->request.response, reserve);
+
+    CURL *curl = request->handle = easyhttp_pool_handle_acquire();
+    if (!curl) {
+        lua_pushnil(L);
+        lua_pushliteral(L, "failed to create curl handle");
+        return 2;
+    }
+    easyhttp_share_attach(easyhttp_share_global(), curl);
+    easyhttp_options_set(request->request.options, curl);
+    err = easyhttp_upload_setup(&request->request.upload, &request->request.options, NULL, curl);
+    if (err) {
+        lua_pushnil(L);
+        lua_pushstring(L, err);
+        return 2;
+    }
+    if (request->request.options.form != LUA_NOREF) {
+        //strings are copied into the form and files opened by curl, so nothing has to be pinned for the event loop
+        request->request.form = easyhttp_form_build(L, request->request.options.form, curl, &err);
+        if (!request->request.form) {
+            lua_pushnil(L);
+            lua_pushstring(L, err);
+            return 2;
+        }
+        curl_easy_setopt(curl, CURLOPT_MIMEPOST, request->request.form);
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, request->request.url);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, request);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, buffer_write);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, request);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_write);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, request);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, progress_callback);
+    curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, request);
+
+    err = loop_submit(request);
+    if (err) {
         lua_pushnil(L);
-        lua_pushfstring(L, "failed to create thread: %s", thread_error_message(i));
+        lua_pushfstring(L, "failed to start event loop: %s", err);
         return 2;
     }
 
@@ -205,7 +589,7 @@ int easyhttp_async_request_is_done(lua_State *L)
 {
     struct easyhttp_AsyncRequest *request = luaL_checkudata(L, 1, EASYHTTP_ASYNC_REQUEST_TNAME);
     mtx_lock(&request->mutex);
-    bool done = request->done;
+    bool done = request->finished;
     mtx_unlock(&request->mutex);
     lua_pushboolean(L, done);
     return 1;
@@ -215,7 +599,18 @@ int easyhttp_async_request_is_done(lua_State *L)
 int easyhttp_async_request_response(lua_State *L)
 {
     struct easyhttp_AsyncRequest *request = luaL_checkudata(L, 1, EASYHTTP_ASYNC_REQUEST_TNAME);
+    //finalizers may run here, so this must be done without holding the lock
+    easyhttp_memory_pace_gc(L);
+
     mtx_lock(&request->mutex);
+    //nothing else will drain the buffer while this waits, so the rest of the body is taken without a limit
+    if (!request->finished) {
+        request->unlimited = true;
+        loop_resume(request);
+    }
+    while (!request->finished)
+        cnd_wait(&request->finished_cond, &request->mutex);
+
     if (request->error) {
         lua_pushnil(L);
         lua_pushstring(L, request->error);
@@ -223,41 +618,27 @@ int easyhttp_async_request_response(lua_State *L)
         return 2;
     }
 
-    if (!request->done) {
-        int res = 0;
-        mtx_unlock(&request->mutex); //so that we can join the thread without deadlock
-        int c = thrd_join(request->thread, &res);
-        if (c != thrd_success) {
-            lua_pushnil(L);
-            lua_pushfstring(L, "failed to join thread: %s", thread_error_message(c));
-            mtx_unlock(&request->mutex);
-            return 2;
-        }
-
-        if (res != 0) {
-            lua_pushnil(L);
-            switch (res) {
-                case EASYHTTP_EXIT_CANCELLED:
-                    lua_pushliteral(L, "request was cancelled");
-                    break;
-                case EASYHTTP_EXIT_ERROR:
-                    lua_pushstring(L, request->error);
-                    break;
-                default:
-                    lua_pushliteral(L, "unknown error");
-                    break;
-            }
-            return 2;
+    if (request->request.options.response_bytes) {
+        //handed over instead of borrowed, `read` and `data` would otherwise free segments the value (or a body sent from it) points to.
+        //It is kept with the anchored values, so calling `response` again returns the same value
+        lua_rawgeti(L, LUA_REGISTRYINDEX, request->anchor);
+        if (request->request.response) {
+            easyhttp_bytes_push(L, request->request.response, 0);
+            request->request.response = NULL;
+            lua_pushvalue(L, -1);
+            lua_rawseti(L, -3, 3);
+        } else {
+            lua_rawgeti(L, -1, 3);
         }
+        lua_remove(L, -2);
+    } else {
+        easyhttp_buffer_push(L, request->request.response);
     }
-
-    lua_pushlstring(L, request->request.response->data, request->request.response->length);
     lua_pushinteger(L, request->request.response_code);
-    lua_newtable(L);
-    for (size_t i = 0; i < request->request.headers->length; i++) {
-        lua_pushstring(L, request->request.headers->headers[i].value);
-        lua_setfield(L, -2, request->request.headers->headers[i].key);
-    }
+    if (request->request.options.response_headers_object)
+        easyhttp_headers_push_object(L, request->request.headers, 1);
+    else
+        easyhttp_headers_push(L, request->request.headers);
     mtx_unlock(&request->mutex);
     return 3;
 }
@@ -270,8 +651,9 @@ int easyhttp_async_request_progress(lua_State *L)
     lua_pushnumber(L, request->request.progress.dltotal);
     lua_pushnumber(L, request->request.progress.ulnow);
     lua_pushnumber(L, request->request.progress.ultotal);
+    lua_pushinteger(L, (lua_Integer)request->request.received);
     mtx_unlock(&request->mutex);
-    return 4;
+    return 5;
 }
 
 int easyhttp_async_request_data(lua_State *L)
@@ -279,7 +661,7 @@ int easyhttp_async_request_data(lua_State *L)
     struct easyhttp_AsyncRequest *request = luaL_checkudata(L, 1, EASYHTTP_ASYNC_REQUEST_TNAME);
     mtx_lock(&request->mutex);
     if (request->request.response) {
-        lua_pushlstring(L, request->request.response->data, request->request.response->length);
+        easyhttp_buffer_push(L, request->request.response);
         lua_pushinteger(L, request->request.response->length);
     } else {
         lua_pushnil(L);
@@ -289,45 +671,79 @@ int easyhttp_async_request_data(lua_State *L)
     return 2;
 }
 
+int easyhttp_async_request_read(lua_State *L)
+{
+    struct easyhttp_AsyncRequest *request = luaL_checkudata(L, 1, EASYHTTP_ASYNC_REQUEST_TNAME);
+    lua_Integer max = luaL_optinteger(L, 2, 0);
+    luaL_argcheck(L, max >= 0, 2, "max_bytes must not be negative");
+
+    mtx_lock(&request->mutex);
+    //without a buffer the body was handed to `response`, which only happens once the request succeeded
+    struct easyhttp_Buffer *response = request->request.response;
+    if (!response || (response->length == 0 && request->finished)) {
+        lua_pushnil(L);
+        if (request->error)
+            lua_pushstring(L, request->error);
+        mtx_unlock(&request->mutex);
+        return request->error ? 2 : 1;
+    }
+
+    easyhttp_buffer_read(L, response, max > 0 ? (size_t)max : SIZE_MAX);
+    //resuming at half the limit rather than straight away avoids pausing again on the next write
+    if (response->length <= request->request.options.max_buffered_bytes / 2)
+        loop_resume(request);
+    mtx_unlock(&request->mutex);
+    return 1;
+}
+
 int easyhttp_async_request_cancel(lua_State *L)
 {
     struct easyhttp_AsyncRequest *request = luaL_checkudata(L, 1, EASYHTTP_ASYNC_REQUEST_TNAME);
     mtx_lock(&request->mutex);
-    if (request->done) {
+    if (request->finished) {
         mtx_unlock(&request->mutex);
         lua_pushboolean(L, false);
         lua_pushliteral(L, "request is already done");
         return 2;
     }
-    request->cancelled = true;
     mtx_unlock(&request->mutex);
 
+    loop_cancel(request);
+
     lua_pushboolean(L, true);
     return 1;
 }
 
-//if extensions
-#if defined(__GNUC__)
-__attribute__((no_sanitize("address", "thread")))
-#endif
 int easyhttp_async_request__gc(lua_State *L)
 {
     struct easyhttp_AsyncRequest *request = luaL_checkudata(L, 1, EASYHTTP_ASYNC_REQUEST_TNAME);
 
-    request->cancelled = true;
-    int res = 0;
-    //if sanitizers are enabled, just don't join, it doesn't work for some reason
-#if !defined(__SANITIZE_ADDRESS__)
-    int err = thrd_join(request->thread, &res);
-    if (err != thrd_success) {
-        return luaL_error(L, "failed to join thread: %s", thread_error_message(err));
+    if (request->queued) {
+        //the event loop still references the request until it signals `finished`
+        loop_cancel(request);
+        mtx_lock(&request->mutex);
+        while (!request->finished)
+            cnd_wait(&request->finished_cond, &request->mutex);
+        mtx_unlock(&request->mutex);
+    } else if (request->handle) {
+        easyhttp_pool_handle_release(request->handle);
+        request->handle = NULL;
+    }
+
+    if (request->initialized) {
+        cnd_destroy(&request->finished_cond);
+        mtx_destroy(&request->mutex);
+        request->initialized = false;
     }
-#endif
-    mtx_destroy(&request->mutex);
 
-    easyhttp_options_free(&request->request.options);
-    free(request->request.response);
+    easyhttp_options_free(L, &request->request.options);
+    easyhttp_buffer_free(&request->request.response);
     easyhttp_headers_free(&request->request.headers);
+    easyhttp_upload_cleanup(&request->request.upload);
+    curl_mime_free(request->request.form);
+    request->request.form = NULL;
+    luaL_unref(L, LUA_REGISTRYINDEX, request->anchor);
+    request->anchor = LUA_NOREF;
 
     return 0;
 }
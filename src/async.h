@@ -7,6 +7,10 @@
 #define EASYHTTP_ASYNC_H
 
 #include "common.h"
+#include "buffer.h"
+#include "headers.h"
+#include "upload.h"
+#include "form.h"
 
 
 
@@ -15,6 +19,8 @@ struct easyhttp_AsyncRequest {
     struct {
         const char *url;
         struct easyhttp_Options options;
+        struct easyhttp_Upload upload; //read from the event loop thread, so no reader functions
+        curl_mime *form;
         struct easyhttp_Buffer *response;
 
         struct {
@@ -23,20 +29,40 @@ struct easyhttp_AsyncRequest {
 
         long response_code;
         struct easyhttp_Headers *headers;
+        size_t received; //bytes of the body received so far
     } request;
 
+    //the url and body are used by the event loop without copying them, they are pinned here until the request is collected
+    LuaReference_t anchor;
     const char *error;
     easyhttp_Atomic_t(bool) cancelled, done;
     mtx_t mutex;
-    thrd_t thread;
+    cnd_t finished_cond;
+    bool initialized; //mutex and condition variable are usable
+
+    //Set once handed to the event loop, which then owns `handle` until `finished` is signalled
+    bool queued, finished;
+    //`max_buffered_bytes` backpressure, `resume` asks the event loop to unpause the transfer
+    bool paused, resume, unlimited;
+    CURL *handle;
+    struct easyhttp_AsyncRequest *prev, *next; //event loop queues, only touched under the loop's lock or on its thread
 };
 
+//Registers the calling state as a user of the event loop, which is stopped once every state using it is closed
+void easyhttp_async_open(lua_State *L);
+//Makes the event loop pick up changes made by `easyhttp.configure`
+void easyhttp_async_reconfigure(void);
+
 int easyhttp_async_request(lua_State *L);
 int easyhttp_async_request_is_done(lua_State *L);
 int easyhttp_async_request_cancel(lua_State *L);
 int easyhttp_async_request_response(lua_State *L);
 int easyhttp_async_request_progress(lua_State *L);
 int easyhttp_async_request_data(lua_State *L);
+/*
+function easyhttp.AsyncRequest:read(max_bytes: integer?): string | (nil, string?)
+*/
+int easyhttp_async_request_read(lua_State *L);
 int easyhttp_async_request__gc(lua_State *L);
 
 #endif //EASYHTTP_ASYNC_H
@@ -0,0 +1,218 @@
+/**
+ * Copyright (c) 2024 Amrit Bhogal
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include "buffer.h"
+#include "pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//Segments of the default size are recycled, others (e.g. presized from a Content-Length) are not
+static struct easyhttp_BufferSegment *segment_create(size_t size)
+{
+    struct easyhttp_BufferSegment *segment = NULL;
+    if (size <= EASYHTTP_BUFFER_SEGMENT_SIZE) {
+        size = EASYHTTP_BUFFER_SEGMENT_SIZE;
+        segment = easyhttp_pool_take(EASYHTTP_POOL_SEGMENTS);
+    }
+    if (!segment)
+        segment = easyhttp_malloc(sizeof(struct easyhttp_BufferSegment) + size);
+    if (!segment)
+        return NULL;
+
+    *segment = (struct easyhttp_BufferSegment) { .cap = size };
+    easyhttp_memory_track_buffered(size, 0);
+    return segment;
+}
+
+static void segment_free(struct easyhttp_BufferSegment *segment)
+{
+    easyhttp_memory_track_buffered(0, segment->cap);
+    if (segment->cap != EASYHTTP_BUFFER_SEGMENT_SIZE || !easyhttp_pool_give(EASYHTTP_POOL_SEGMENTS, segment))
+        easyhttp_free(segment);
+}
+
+struct easyhttp_Buffer *easyhttp_buffer_create(void)
+{
+    struct easyhttp_Buffer *buffer = easyhttp_pool_take(EASYHTTP_POOL_BUFFERS);
+    if (!buffer)
+        buffer = easyhttp_malloc(sizeof(struct easyhttp_Buffer));
+    if (!buffer)
+        return NULL;
+
+    *buffer = (struct easyhttp_Buffer) {0};
+    return buffer;
+}
+
+void easyhttp_buffer_free(struct easyhttp_Buffer **buffer)
+{
+    if (!buffer || !*buffer) return;
+    for (struct easyhttp_BufferSegment *it = (*buffer)->head, *next; it; it = next) {
+        next = it->next;
+        segment_free(it);
+    }
+
+    if (!easyhttp_pool_give(EASYHTTP_POOL_BUFFERS, *buffer))
+        easyhttp_free(*buffer);
+    *buffer = NULL;
+}
+
+bool easyhttp_buffer_reserve(struct easyhttp_Buffer *buffer, size_t size)
+{
+    if (buffer->tail && buffer->tail->cap - buffer->tail->length >= size)
+        return true;
+    if (size > SIZE_MAX - sizeof(struct easyhttp_BufferSegment))
+        return false;
+
+    struct easyhttp_BufferSegment *segment = segment_create(size);
+    if (!segment)
+        return false;
+
+    //an empty tail (e.g. a failed reservation that was retried) would only be dead weight in the list
+    if (buffer->tail && buffer->tail->length == buffer->tail->start) {
+        struct easyhttp_BufferSegment **it = &buffer->head;
+        while (*it != buffer->tail) it = &(*it)->next;
+        segment_free(buffer->tail);
+        *it = segment;
+    } else if (buffer->tail) {
+        buffer->tail->next = segment;
+    } else {
+        buffer->head = segment;
+    }
+    buffer->tail = segment;
+    return true;
+}
+
+bool easyhttp_buffer_append(struct easyhttp_Buffer *buffer, size_t size, const char data[static size])
+{
+    while (size > 0) {
+        struct easyhttp_BufferSegment *tail = buffer->tail;
+        if (!tail || tail->length == tail->cap) {
+            if (!easyhttp_buffer_reserve(buffer, size > EASYHTTP_BUFFER_SEGMENT_SIZE ? size : EASYHTTP_BUFFER_SEGMENT_SIZE))
+                return false;
+            tail = buffer->tail;
+        }
+
+        size_t n = tail->cap - tail->length;
+        if (n > size) n = size;
+        memcpy(tail->data + tail->length, data, n);
+        tail->length += n;
+        buffer->length += n;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+size_t easyhttp_buffer_write(void *data, size_t size, size_t nmemb, struct easyhttp_Buffer *buffer)
+{ return easyhttp_buffer_append(buffer, size * nmemb, data) ? size * nmemb : 0; }
+
+void easyhttp_buffer_presize(struct easyhttp_Buffer *buffer, const char *header, size_t length)
+{
+    static const char name[] = "content-length:";
+    if (length < sizeof(name) - 1)
+        return;
+    for (size_t i = 0; i < sizeof(name) - 1; i++) {
+        char c = header[i];
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        if (c != name[i]) return;
+    }
+
+    size_t content_length = 0;
+    const char *it = header + sizeof(name) - 1, *end = header + length;
+    while (it < end && (*it == ' ' || *it == '\t')) it++;
+    if (it == end || *it < '0' || *it > '9')
+        return;
+    for (; it < end && *it >= '0' && *it <= '9'; it++) {
+        if (content_length > (SIZE_MAX - 9) / 10)
+            return;
+        content_length = content_length * 10 + (size_t)(*it - '0');
+    }
+
+    if (content_length > 0)
+        easyhttp_buffer_reserve(buffer, content_length);
+}
+
+const char *easyhttp_buffer_flatten(struct easyhttp_Buffer *buffer)
+{
+    if (!buffer->head)
+        return "";
+    if (buffer->head->length - buffer->head->start == buffer->length)
+        return buffer->head->data + buffer->head->start;
+
+    struct easyhttp_BufferSegment *segment = easyhttp_malloc(sizeof(struct easyhttp_BufferSegment) + buffer->length);
+    if (!segment)
+        return NULL;
+    *segment = (struct easyhttp_BufferSegment) { .cap = buffer->length, .length = buffer->length };
+
+    char *out = segment->data;
+    for (struct easyhttp_BufferSegment *it = buffer->head, *next; it; it = next) {
+        next = it->next;
+        memcpy(out, it->data + it->start, it->length - it->start);
+        out += it->length - it->start;
+        segment_free(it);
+    }
+
+    buffer->head = buffer->tail = segment;
+    return segment->data;
+}
+
+void easyhttp_buffer_push(lua_State *L, const struct easyhttp_Buffer *buffer)
+{
+    //the common case of a presized body, which can go straight into the string
+    if (!buffer->head || buffer->head->length - buffer->head->start == buffer->length) {
+        lua_pushlstring(L, buffer->head ? buffer->head->data + buffer->head->start : "", buffer->length);
+        return;
+    }
+
+    luaL_Buffer result;
+    char *out = luaL_buffinitsize(L, &result, buffer->length);
+    for (struct easyhttp_BufferSegment *it = buffer->head; it; it = it->next) {
+        memcpy(out, it->data + it->start, it->length - it->start);
+        out += it->length - it->start;
+    }
+    luaL_pushresultsize(&result, buffer->length);
+}
+
+size_t easyhttp_buffer_read(lua_State *L, struct easyhttp_Buffer *buffer, size_t max)
+{
+    size_t size = max < buffer->length ? max : buffer->length;
+
+    //copied before anything is removed, pushing the string may raise an error
+    luaL_Buffer result;
+    char *out = luaL_buffinitsize(L, &result, size);
+    size_t left = size;
+    for (struct easyhttp_BufferSegment *it = buffer->head; it && left > 0; it = it->next) {
+        size_t n = it->length - it->start;
+        if (n > left) n = left;
+        memcpy(out, it->data + it->start, n);
+        out += n;
+        left -= n;
+    }
+    luaL_pushresultsize(&result, size);
+
+    left = size;
+    while (buffer->head && left > 0) {
+        struct easyhttp_BufferSegment *head = buffer->head;
+        size_t n = head->length - head->start;
+        if (n > left) {
+            head->start += left;
+            break;
+        }
+        left -= n;
+
+        //the tail is still being written into, so it is emptied rather than freed
+        if (head == buffer->tail) {
+            head->start = head->length = 0;
+            break;
+        }
+        buffer->head = head->next;
+        segment_free(head);
+    }
+    buffer->length -= size;
+    return size;
+}
@@ -0,0 +1,49 @@
+// Copyright (c) 2024 Amrit Bhogal
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef EASYHTTP_BUFFER_H
+#define EASYHTTP_BUFFER_H
+
+#include "common.h"
+
+//Size of the segments data is appended into, curl hands over at most CURL_MAX_WRITE_SIZE bytes per write
+#define EASYHTTP_BUFFER_SEGMENT_SIZE ((size_t)CURL_MAX_WRITE_SIZE)
+
+//Holds `data[start..length)`, everything before `start` was already read
+struct easyhttp_BufferSegment {
+    struct easyhttp_BufferSegment *next;
+    size_t cap, start, length;
+    char data[];
+};
+
+//Response body stored as a list of segments, so appending never moves data which was already received
+//and data which was read can be freed straight away
+struct easyhttp_Buffer {
+    size_t length; //bytes which have not been read
+    struct easyhttp_BufferSegment *head, *tail;
+};
+
+struct easyhttp_Buffer *easyhttp_buffer_create(void);
+void easyhttp_buffer_free(struct easyhttp_Buffer **buffer);
+
+//Makes room for at least `size` more bytes in a single segment, returns false if it could not be allocated
+bool easyhttp_buffer_reserve(struct easyhttp_Buffer *buffer, size_t size);
+bool easyhttp_buffer_append(struct easyhttp_Buffer *buffer, size_t size, const char data[static size]);
+//CURLOPT_WRITEFUNCTION compatible
+size_t easyhttp_buffer_write(void *data, size_t size, size_t nmemb, struct easyhttp_Buffer *buffer);
+
+//Reserves the rest of the body if `header` is a Content-Length header. This is only a hint,
+//so failing to allocate (e.g. for a bogus length) is not an error.
+void easyhttp_buffer_presize(struct easyhttp_Buffer *buffer, const char *header, size_t length);
+
+//Moves the contents into a single segment, returns a pointer to them or NULL if it could not be allocated
+const char *easyhttp_buffer_flatten(struct easyhttp_Buffer *buffer);
+
+//Pushes the contents as a single Lua string
+void easyhttp_buffer_push(lua_State *L, const struct easyhttp_Buffer *buffer);
+//Pushes at most `max` bytes from the front as a Lua string and removes them, returns how many were pushed
+size_t easyhttp_buffer_read(lua_State *L, struct easyhttp_Buffer *buffer, size_t max);
+
+#endif //EASYHTTP_BUFFER_H
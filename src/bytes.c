@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) 2024 Amrit Bhogal
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include "bytes.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+void easyhttp_bytes_push(lua_State *L, struct easyhttp_Buffer *buffer, int owner)
+{
+    if (owner) owner = lua_absindex(L, owner);
+
+    struct easyhttp_Bytes *bytes = lua_newuserdata(L, sizeof(struct easyhttp_Bytes));
+    *bytes = (struct easyhttp_Bytes) { .buffer = buffer, .owned = owner == 0 };
+    luaL_setmetatable(L, EASYHTTP_BYTES_TNAME);
+
+    if (owner) {
+        //5.1 only takes tables as uservalues
+        lua_createtable(L, 1, 0);
+        lua_pushvalue(L, owner);
+        lua_rawseti(L, -2, 1);
+        lua_setuservalue(L, -2);
+    }
+}
+
+static struct easyhttp_Buffer *check_buffer(lua_State *L, int idx)
+{
+    struct easyhttp_Bytes *bytes = luaL_checkudata(L, idx, EASYHTTP_BYTES_TNAME);
+    if (!bytes->buffer)
+        luaL_error(L, "attempt to use a freed bytes value");
+    return bytes->buffer;
+}
+
+const char *easyhttp_bytes_tobody(lua_State *L, int idx, size_t *length)
+{
+    if (!luaL_testudata(L, idx, EASYHTTP_BYTES_TNAME))
+        return NULL;
+
+    //once flattened the data doesn't move again, so it can be read from another thread while Lua keeps using the value.
+    //That only holds while nothing else can change the buffer, which borrowed ones don't guarantee
+    struct easyhttp_Buffer *buffer = check_buffer(L, idx);
+    if (!((struct easyhttp_Bytes *)lua_touserdata(L, idx))->owned)
+        luaL_error(L, "borrowed bytes can't be sent as a body, copy them with tostring first");
+    const char *data = easyhttp_buffer_flatten(buffer);
+    if (!data)
+        luaL_error(L, "failed to allocate memory for body");
+    *length = buffer->length;
+    return data;
+}
+
+//string.sub style index, 1-based, negative values count from the end
+static size_t relative_index(lua_Integer i, size_t length)
+{
+    if (i >= 0) return (size_t)i;
+    if (0u - (size_t)i > length) return 0;
+    return length - (0u - (size_t)i) + 1;
+}
+
+int easyhttp_bytes_len(lua_State *L)
+{
+    lua_pushinteger(L, check_buffer(L, 1)->length);
+    return 1;
+}
+
+int easyhttp_bytes_sub(lua_State *L)
+{
+    struct easyhttp_Buffer *buffer = check_buffer(L, 1);
+    size_t start = relative_index(luaL_checkinteger(L, 2), buffer->length),
+           end = relative_index(luaL_optinteger(L, 3, -1), buffer->length);
+    if (start < 1) start = 1;
+    if (end > buffer->length) end = buffer->length;
+    if (start > end) {
+        lua_pushliteral(L, "");
+        return 1;
+    }
+
+    //only the requested range is copied, straight out of the segments
+    size_t offset = start - 1, length = end - start + 1;
+    luaL_Buffer result;
+    char *out = luaL_buffinitsize(L, &result, length);
+    for (struct easyhttp_BufferSegment *it = buffer->head; it && length > 0; it = it->next) {
+        size_t available = it->length - it->start;
+        if (offset >= available) {
+            offset -= available;
+            continue;
+        }
+
+        size_t n = available - offset;
+        if (n > length) n = length;
+        memcpy(out, it->data + it->start + offset, n);
+        out += n;
+        length -= n;
+        offset = 0;
+    }
+    luaL_pushresultsize(&result, end - start + 1);
+    return 1;
+}
+
+int easyhttp_bytes_find(lua_State *L)
+{
+    struct easyhttp_Buffer *buffer = check_buffer(L, 1);
+    size_t needle_length = 0;
+    const char *needle = luaL_checklstring(L, 2, &needle_length);
+    size_t init = relative_index(luaL_optinteger(L, 3, 1), buffer->length);
+    if (init < 1) init = 1;
+    if (init > buffer->length + 1) {
+        lua_pushnil(L);
+        return 1;
+    }
+    if (needle_length == 0) {
+        lua_pushinteger(L, init);
+        lua_pushinteger(L, init - 1);
+        return 2;
+    }
+
+    //matches may span segments, searching is far simpler on a single block
+    const char *data = easyhttp_buffer_flatten(buffer);
+    if (!data)
+        return luaL_error(L, "failed to allocate memory for bytes");
+
+    const char *it = data + init - 1, *end = data + buffer->length;
+    while ((size_t)(end - it) >= needle_length) {
+        it = memchr(it, needle[0], (size_t)(end - it) - needle_length + 1);
+        if (!it)
+            break;
+        if (memcmp(it, needle, needle_length) == 0) {
+            lua_pushinteger(L, it - data + 1);
+            lua_pushinteger(L, it - data + needle_length);
+            return 2;
+        }
+        it++;
+    }
+
+    lua_pushnil(L);
+    return 1;
+}
+
+int easyhttp_bytes_tostring(lua_State *L)
+{
+    easyhttp_buffer_push(L, check_buffer(L, 1));
+    return 1;
+}
+
+int easyhttp_bytes_write(lua_State *L)
+{
+    struct easyhttp_Buffer *buffer = check_buffer(L, 1);
+    FILE **file = luaL_checkudata(L, 2, "FILE*");
+    if (!*file)
+        return luaL_argerror(L, 2, "attempt to use a closed file");
+
+    for (struct easyhttp_BufferSegment *it = buffer->head; it; it = it->next) {
+        if (fwrite(it->data + it->start, 1, it->length - it->start, *file) != it->length - it->start) {
+            lua_pushnil(L);
+            lua_pushfstring(L, "failed to write bytes: %s", strerror(errno));
+            return 2;
+        }
+    }
+
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+int easyhttp_bytes__gc(lua_State *L)
+{
+    struct easyhttp_Bytes *bytes = luaL_checkudata(L, 1, EASYHTTP_BYTES_TNAME);
+    if (bytes->owned)
+        easyhttp_buffer_free(&bytes->buffer);
+    bytes->buffer = NULL;
+    return 0;
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2024 Amrit Bhogal
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef EASYHTTP_BYTES_H
+#define EASYHTTP_BYTES_H
+
+#include "common.h"
+#include "buffer.h"
+
+//Response body handed to Lua without copying it into a string
+#define EASYHTTP_BYTES_TNAME "easyhttp.Bytes"
+struct easyhttp_Bytes {
+    struct easyhttp_Buffer *buffer;
+    bool owned; //otherwise the buffer belongs to the value kept in the uservalue
+};
+
+//Pushes a Bytes value for `buffer`. If `owner` is 0 the value takes ownership of the buffer,
+//else the value at `owner` is kept alive for as long as the Bytes value is.
+void easyhttp_bytes_push(lua_State *L, struct easyhttp_Buffer *buffer, int owner);
+
+/*
+function easyhttp.Bytes:len(): integer
+*/
+int easyhttp_bytes_len(lua_State *L);
+/*
+function easyhttp.Bytes:sub(i: integer, j: integer?): string
+*/
+int easyhttp_bytes_sub(lua_State *L);
+/*
+function easyhttp.Bytes:find(needle: string, init: integer?): (integer, integer) | nil
+*/
+int easyhttp_bytes_find(lua_State *L);
+/*
+function easyhttp.Bytes:tostring(): string
+*/
+int easyhttp_bytes_tostring(lua_State *L);
+/*
+function easyhttp.Bytes:write(file: FILE): true | (nil, string error)
+*/
+int easyhttp_bytes_write(lua_State *L);
+int easyhttp_bytes__gc(lua_State *L);
+
+#endif //EASYHTTP_BYTES_H
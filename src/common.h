@@ -26,38 +26,55 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
 #include <curl/curl.h>
 
+#include "memory.h"
+
 typedef int LuaReference_t;
 
-struct easyhttp_Buffer {
-    size_t cap, length;
-    char data[];
+enum easyhttp_Compression {
+    EASYHTTP_COMPRESSION_NONE,
+    EASYHTTP_COMPRESSION_GZIP,
 };
 
 struct easyhttp_Options {
     const char *method, *body;
+    //`body` may contain zeros, for streamed bodies it is the size if known up front, -1 otherwise (sent chunked)
+    curl_off_t body_length;
+    //bodies streamed instead of held in memory, at most one of `body`, `body_file`, `body_stream` and `body_reader` is set
+    const char *body_file;
+    FILE **body_stream;
+    LuaReference_t body_reader;
+    LuaReference_t form; //multipart fields, built into a curl_mime by easyhttp_form_build
+    enum easyhttp_Compression compress_body; //the body is compressed while it is sent, and sent chunked
     bool follow_redirects;
     int timeout, max_redirects;
+    long http_version, dns_cache_timeout;
+    size_t expected_size; //hint for the size of the response body, when it is not known from the headers
+    size_t max_buffered_bytes; //async transfers pause once this much of the body is waiting to be read
+    size_t max_response_size; //transfers are aborted once the body grows past this
+    const char *accept_encoding; //encodings to ask for and decode, "" for all of curl's, NULL leaves the body as sent
+    bool response_bytes; //return the body as an `easyhttp.Bytes` instead of a string
+    bool response_headers_object; //return the headers as an `easyhttp.Headers` instead of a table
     FILE **output_file;
-    struct curl_slist *headers;
+    //`output_file` keeps what is already in it, and the rest is requested with a Range (and If-Range with `resume_etag`)
+    bool resume;
+    const char *resume_etag;
+    int retries; //resumed downloads are retried this many times after a transient error
+    struct curl_slist *headers, *resolve, *connect_to;
 
     LuaReference_t on_data, on_progress;
-};
 
-struct easyhttp_Header {
-    char *key, *value;
-};
-struct easyhttp_Headers {
-    size_t length;
-    struct easyhttp_Header headers[];
+    //Options this set was parsed on top of (e.g. session defaults), lists not set here fall back to these
+    const struct easyhttp_Options *defaults;
 };
 
 static inline char *string_duplicate_n(const char *str, size_t len)
 {
-    char *dup = malloc(len + 1);
+    char *dup = easyhttp_malloc(len + 1);
     if (!dup) return NULL;
     memcpy(dup, str, len);
     dup[len] = '\0';
@@ -69,78 +86,16 @@ static inline char *string_duplicate(const char *str)
     return string_duplicate_n(str, strlen(str));
 }
 
-#pragma region Headers
-
-static inline struct easyhttp_Headers *easyhttp_headers_create()
-{ return calloc(1, sizeof(struct easyhttp_Headers)); }
-
-static struct easyhttp_Headers *easyhttp_headers_append(struct easyhttp_Headers *headers, const char *key, const char *value)
-{
-    size_t new_len = headers->length + 1;
-    void *tmp = realloc(headers, sizeof(struct easyhttp_Headers) + new_len * sizeof(struct easyhttp_Header));
-    if (!tmp) {
-        return NULL;
-    }
-    headers = tmp;
-    headers->length = new_len;
-
-    headers->headers[new_len - 1] = (struct easyhttp_Header) {
-        .key = string_duplicate(key),
-        .value = string_duplicate(value)
-    };
-
-    return headers;
-}
-
-static size_t easyhttp_headers_write(char *buf, size_t size, size_t nmemb, void *userp)
-{
-    struct easyhttp_Headers **headers = userp;
-    char *header = string_duplicate_n(buf, size * nmemb);
-    if (!header)
-        return 0;
-
-
-    char *colon = strchr(header, ':');
-    if (!colon) {
-        free(header);
-        return size * nmemb;
-    }
-
-    *colon = '\0';
-    char *value = colon + 1;
-    while (*value == ' ' || *value == '\t') value++;
-    //set last char to null to ignore trailing newlines
-    char *end = value + strlen(value) - 1;
-    while (*end == '\n' || *end == '\r') *end-- = '\0';
-
-    *headers = easyhttp_headers_append(*headers, header, value);
-    if (!*headers || !(*headers)->headers[(*headers)->length - 1].key || !(*headers)->headers[(*headers)->length - 1].value) {
-        free(header);
-        return 0;
-    }
-    free(header);
-    return size * nmemb;
-}
-
-static void easyhttp_headers_free(struct easyhttp_Headers **headers)
-{
-    if (!headers || !*headers) return;
-    for (size_t i = 0; i < (*headers)->length; i++) {
-        free((*headers)->headers[i].key);
-        free((*headers)->headers[i].value);
-    }
-
-    free(*headers);
-    *headers = NULL;
-}
-
-#pragma endregion
-
 #pragma region Options
 
 static const struct easyhttp_Options EASYHTTP_DEFAULT_OPTIONS = {
     .method = "GET",
+    .body_length = -1,
+    .body_reader = LUA_NOREF,
+    .form = LUA_NOREF,
     .max_redirects = -1,
+    .dns_cache_timeout = 60, //curl's default
+    .retries = 3,
     .on_data = LUA_NOREF,
     .on_progress = LUA_NOREF,
 };
@@ -153,7 +108,7 @@ static const struct easyhttp_Options EASYHTTP_DEFAULT_OPTIONS = {
     lua_pop(L, 1);\
 } while(0)
 
-static LuaReference_t easyhttp_lua_checkfunction(lua_State *L, int idx)
+static inline LuaReference_t easyhttp_lua_checkfunction(lua_State *L, int idx)
 {
     luaL_checktype(L, idx, LUA_TFUNCTION);
     int ref = luaL_ref(L, LUA_REGISTRYINDEX);
@@ -161,126 +116,397 @@ static LuaReference_t easyhttp_lua_checkfunction(lua_State *L, int idx)
     return ref;
 }
 
-static struct easyhttp_Options easyhttp_options_parse(lua_State *L, int idx, const char **error)
-{
-    struct easyhttp_Options options = EASYHTTP_DEFAULT_OPTIONS;
+//The contents of the `easyhttp.Bytes` at `idx` as one block, NULL if it isn't one (defined in bytes.c)
+const char *easyhttp_bytes_tobody(lua_State *L, int idx, size_t *length);
 
-    options_getfield(output_file,       luaL_checkudata, "FILE*");
-    options_getfield(method,            luaL_checkstring);
-    options_getfield(body,              luaL_checkstring);
-    options_getfield(timeout,           luaL_checkinteger);
-    options_getfield(follow_redirects,  lua_toboolean);
-    options_getfield(max_redirects,     luaL_checkinteger);
-    options_getfield(on_data,           easyhttp_lua_checkfunction);
-    options_getfield(on_progress,       easyhttp_lua_checkfunction);
+//Raises unless the field `key` of the table at `idx` is nil or a `type`
+static inline void easyhttp_lua_checkfield(lua_State *L, int idx, const char *key, int type)
+{
+    lua_getfield(L, idx, key);
+    if (!lua_isnil(L, -1) && lua_type(L, -1) != type)
+        luaL_error(L, "%s must be a %s, got %s", key, lua_typename(L, type), luaL_typename(L, -1));
+    lua_pop(L, 1);
+}
 
-    lua_getfield(L, idx, "headers");
-    if (!lua_isnil(L, -1)) {
-        if (!lua_istable(L, -1)) {
-            *error = "headers must be a table";
-            return options;
+//`body` is either a string, an `easyhttp.Bytes`, a FILE* or a function returning the next piece of it.
+//Returns true for a function, which the caller references once nothing else can raise an error
+static inline bool easyhttp_lua_checkbody(lua_State *L, int idx, struct easyhttp_Options *options)
+{
+    options->body = options->body_file = NULL;
+    options->body_stream = NULL;
+    options->body_reader = options->form = LUA_NOREF;
+
+    switch (lua_type(L, idx)) {
+        case LUA_TSTRING: {
+            size_t length = 0;
+            options->body = lua_tolstring(L, idx, &length);
+            options->body_length = (curl_off_t)length;
+            break;
         }
-
-        size_t alloc_siz = 0;
-        char *buf = malloc(1);
-        if (!buf) {
-            *error = "failed to allocate memory for headers";
-            return options;
+        case LUA_TFUNCTION:
+            return true;
+        case LUA_TUSERDATA: {
+            //sent without copying, like strings
+            size_t length = 0;
+            if ((options->body = easyhttp_bytes_tobody(L, idx, &length)))
+                options->body_length = (curl_off_t)length;
+            else
+                options->body_stream = luaL_checkudata(L, idx, "FILE*");
+            break;
         }
+        default:
+            luaL_error(L, "body must be a string, bytes, a file or a function, got %s", luaL_typename(L, idx));
+    }
+    return false;
+}
 
-        lua_pushnil(L);
-        while (lua_next(L, -2)) {
-            const char  *key = luaL_checkstring(L, -2),
-                        *value = luaL_checkstring(L, -1);
-            size_t key_len = strlen(key), value_len = strlen(value);
-
-            //Only realloc if the new size is greater than the current size, to save on realloc calls
-            if (key_len + value_len + 3 > alloc_siz) {
-                alloc_siz = key_len + value_len + 3;
-                void *tmp = realloc(buf, alloc_siz);
-                if (!tmp) {
-                    *error = "failed to resize memory for headers";
-                    return options;
-                }
-                buf = tmp;
+//Checks a { name = string | { data = string?, path = string?, type = string?, filename = string? } } table,
+//list entries name themselves with a `name` field, for fields which repeat or have to be in order
+static inline void easyhttp_lua_checkform(lua_State *L, int idx)
+{
+    idx = lua_absindex(L, idx);
+    luaL_checktype(L, idx, LUA_TTABLE);
+
+    //checked up front, so building the form can't raise an error halfway through
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        bool listed = lua_type(L, -2) == LUA_TNUMBER;
+        if (!listed && lua_type(L, -2) != LUA_TSTRING)
+            luaL_error(L, "form keys must be field names or list indices");
+
+        if (lua_istable(L, -1)) {
+            static const char *const fields[] = { "name", "data", "path", "type", "filename" };
+            for (size_t i = 0; i < sizeof(fields) / sizeof(*fields); i++) {
+                lua_getfield(L, -1, fields[i]);
+                if (!lua_isnil(L, -1) && lua_type(L, -1) != LUA_TSTRING)
+                    luaL_error(L, "form field %s must be a string", fields[i]);
+                lua_pop(L, 1);
             }
 
-            snprintf(buf, alloc_siz, "%s: %s", key, value);
-            options.headers = curl_slist_append(options.headers, buf);
-            lua_pop(L, 1);
+            lua_getfield(L, -1, "data");
+            lua_getfield(L, -2, "path");
+            if (lua_isnil(L, -1) == lua_isnil(L, -2))
+                luaL_error(L, "form parts must have exactly one of data and path");
+            lua_getfield(L, -3, "name");
+            if (listed && lua_isnil(L, -1))
+                luaL_error(L, "listed form parts must have a name");
+            lua_pop(L, 3);
+        } else if (listed || lua_type(L, -1) != LUA_TSTRING) {
+            luaL_error(L, "form values must be strings or part tables");
         }
-
-        free(buf);
         lua_pop(L, 1);
     }
-    lua_pop(L, 1);
+}
 
-    *error = 0;
-    return options;
+//Sizes are size_t, so a negative one would wrap around to a huge one
+static inline size_t easyhttp_lua_checksize(lua_State *L, int idx, const char *name)
+{
+    lua_Integer size = luaL_checkinteger(L, idx);
+    if (size < 0)
+        luaL_error(L, "%s must not be negative", name);
+    return (size_t)size;
 }
 
-static inline void easyhttp_options_set(struct easyhttp_Options options, CURL *curl)
+static inline long easyhttp_lua_checkhttpversion(lua_State *L, int idx)
 {
-    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, options.method);
-    if (options.body)
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, options.body);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, options.timeout);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, options.follow_redirects);
-    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, options.max_redirects);
-    if (options.headers)
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, options.headers);
+    static const char *const names[] = { "1.0", "1.1", "2", "2-prior-knowledge", NULL };
+    static const long versions[] = {
+        CURL_HTTP_VERSION_1_0,
+        CURL_HTTP_VERSION_1_1,
+        CURL_HTTP_VERSION_2TLS, //falls back to 1.1 for plain http, instead of an upgrade round trip
+        CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE,
+    };
+    return versions[luaL_checkoption(L, idx, NULL, names)];
 }
 
-static void easyhttp_options_free(struct easyhttp_Options *options)
+static inline enum easyhttp_Compression easyhttp_lua_checkcompression(lua_State *L, int idx)
 {
-    curl_slist_free_all(options->headers);
-    *options = (struct easyhttp_Options){0};
+    static const char *const names[] = { "gzip", NULL };
+    static const enum easyhttp_Compression compressions[] = { EASYHTTP_COMPRESSION_GZIP };
+    return compressions[luaL_checkoption(L, idx, NULL, names)];
 }
 
-#pragma endregion
+//`compressed` is either a boolean or a list of encodings such as "gzip,br,zstd"
+static inline const char *easyhttp_lua_checkcompressed(lua_State *L, int idx)
+{
+    if (lua_isboolean(L, idx))
+        return lua_toboolean(L, idx) ? "" : NULL;
+    return luaL_checkstring(L, idx);
+}
+
+static inline bool easyhttp_lua_checkresponsebody(lua_State *L, int idx)
+{
+    static const char *const names[] = { "string", "bytes", NULL };
+    return luaL_checkoption(L, idx, NULL, names) == 1;
+}
 
-#pragma region Buffer
-static inline struct easyhttp_Buffer *easyhttp_buffer_create()
+static inline bool easyhttp_lua_checkresponseheaders(lua_State *L, int idx)
 {
-    struct easyhttp_Buffer *buf = calloc(1, sizeof(struct easyhttp_Buffer) + 1);
-    if (!buf) return NULL;
-    buf->cap = 1;
-    return buf;
+    static const char *const names[] = { "table", "object", NULL };
+    return luaL_checkoption(L, idx, NULL, names) == 1;
 }
 
-static struct easyhttp_Buffer *easyhttp_buffer_append(struct easyhttp_Buffer *buffer, size_t size, const char data[static size])
+//Checks a { ["host:port"] = string | { string } } table
+static inline void easyhttp_lua_checkhostmap(lua_State *L, int idx)
 {
-    if (buffer->length + size > buffer->cap) {
-        size_t new_cap = buffer->cap * 2;
-        while (new_cap < buffer->length + size) {
-            new_cap *= 2;
+    idx = lua_absindex(L, idx);
+    luaL_checktype(L, idx, LUA_TTABLE);
+
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        if (lua_type(L, -2) != LUA_TSTRING)
+            luaL_error(L, "host map keys must be \"host:port\" strings");
+        if (lua_istable(L, -1)) {
+            for (size_t i = 1, n = lua_rawlen(L, -1); i <= n; i++) {
+                lua_rawgeti(L, -1, i);
+                if (lua_type(L, -1) != LUA_TSTRING)
+                    luaL_error(L, "host map entry for '%s' must only contain strings", lua_tostring(L, -3));
+                lua_pop(L, 1);
+            }
+        } else if (lua_type(L, -1) != LUA_TSTRING) {
+            luaL_error(L, "host map entry for '%s' must be a string or a list of strings", lua_tostring(L, -2));
         }
+        lua_pop(L, 1);
+    }
+}
 
-        void *tmp = realloc(buffer, sizeof(struct easyhttp_Buffer) + new_cap);
-        if (!tmp) {
-            return NULL;
+//Builds curl's "host:port:value" entries from a table checked by easyhttp_lua_checkhostmap, lists are joined with ','
+static inline struct curl_slist *easyhttp_lua_tohostmap(lua_State *L, int idx)
+{
+    idx = lua_absindex(L, idx);
+    struct curl_slist *list = NULL;
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        //the buffer may keep its own values on the stack
+        int key = lua_gettop(L) - 1, value = lua_gettop(L);
+
+        luaL_Buffer entry;
+        luaL_buffinit(L, &entry);
+        lua_pushvalue(L, key);
+        luaL_addvalue(&entry);
+        luaL_addchar(&entry, ':');
+
+        if (lua_istable(L, value)) {
+            for (size_t i = 1, n = lua_rawlen(L, value); i <= n; i++) {
+                if (i > 1) luaL_addchar(&entry, ',');
+                lua_rawgeti(L, value, i);
+                luaL_addvalue(&entry);
+            }
+        } else {
+            lua_pushvalue(L, value);
+            luaL_addvalue(&entry);
         }
-        buffer = tmp;
-        buffer->cap = new_cap;
+
+        luaL_pushresult(&entry);
+        list = curl_slist_append(list, lua_tostring(L, -1));
+        lua_settop(L, key);
     }
 
-    memcpy(buffer->data + buffer->length, data, size);
-    buffer->length += size;
-    buffer->data[buffer->length] = '\0';
-    return buffer;
+    return list;
 }
 
-static int easyhttp_buffer_write(void *data, size_t size, size_t nmemb, struct easyhttp_Buffer **buffer)
+//Parses the options at `idx` on top of `defaults`, which must outlive the returned options
+static inline struct easyhttp_Options easyhttp_options_parse_from(lua_State *L, int idx, const struct easyhttp_Options *defaults, const char **error)
 {
-    size_t new_size = (*buffer)->length + size * nmemb;
+    struct easyhttp_Options options = *defaults;
+    options.headers = options.resolve = options.connect_to = NULL;
+    options.defaults = defaults;
+    idx = lua_absindex(L, idx);
+
+    //every field is checked before anything is referenced or allocated, so a raised error leaks nothing
+    options_getfield(output_file,        luaL_checkudata, "FILE*");
+    lua_getfield(L, idx, "resume");
+    if (!lua_isnil(L, -1)) {
+        //a string is the ETag of the partial file, from the headers of an earlier attempt
+        options.resume_etag = lua_type(L, -1) == LUA_TSTRING ? lua_tostring(L, -1) : NULL;
+        options.resume = options.resume_etag || lua_toboolean(L, -1);
+    }
+    lua_pop(L, 1);
+    options_getfield(retries,            luaL_checkinteger);
+    options_getfield(method,             luaL_checkstring);
+    options_getfield(body_length,        luaL_checkinteger);
+    options_getfield(compress_body,      easyhttp_lua_checkcompression);
+    options_getfield(timeout,            luaL_checkinteger);
+    options_getfield(follow_redirects,   lua_toboolean);
+    options_getfield(max_redirects,      luaL_checkinteger);
+    options_getfield(http_version,       easyhttp_lua_checkhttpversion);
+    options_getfield(dns_cache_timeout,  luaL_checkinteger);
+    options_getfield(expected_size,      easyhttp_lua_checksize, "expected_size");
+    options_getfield(max_buffered_bytes, easyhttp_lua_checksize, "max_buffered_bytes");
+    options_getfield(max_response_size,  easyhttp_lua_checksize, "max_response_size");
+    lua_getfield(L, idx, "compressed");
+    if (!lua_isnil(L, -1))
+        options.accept_encoding = easyhttp_lua_checkcompressed(L, -1);
+    lua_pop(L, 1);
+    lua_getfield(L, idx, "response_body");
+    if (!lua_isnil(L, -1))
+        options.response_bytes = easyhttp_lua_checkresponsebody(L, -1);
+    lua_pop(L, 1);
+    lua_getfield(L, idx, "response_headers");
+    if (!lua_isnil(L, -1))
+        options.response_headers_object = easyhttp_lua_checkresponseheaders(L, -1);
+    lua_pop(L, 1);
+
+    lua_getfield(L, idx, "body");
+    bool has_body = !lua_isnil(L, -1), body_reader = has_body && easyhttp_lua_checkbody(L, -1, &options);
+    lua_pop(L, 1);
+    lua_getfield(L, idx, "body_file");
+    if (!lua_isnil(L, -1)) {
+        if (has_body) {
+            *error = "body and body_file are mutually exclusive";
+            return options;
+        }
+        has_body = true;
+        options.body_file = luaL_checkstring(L, -1);
+        options.body = NULL;
+        options.body_stream = NULL;
+        options.body_reader = options.form = LUA_NOREF;
+    }
+    lua_pop(L, 1);
+    lua_getfield(L, idx, "form");
+    bool form = !lua_isnil(L, -1);
+    if (form) {
+        if (has_body) {
+            *error = "form can't be combined with body or body_file";
+            return options;
+        }
+        easyhttp_lua_checkform(L, -1);
+        options.body = options.body_file = NULL;
+        options.body_stream = NULL;
+        options.body_reader = LUA_NOREF;
+    }
+    lua_pop(L, 1);
+    if (options.compress_body != EASYHTTP_COMPRESSION_NONE && (form || options.form != LUA_NOREF)) {
+        *error = "compress_body can't be used with form";
+        return options;
+    }
+    lua_getfield(L, idx, "resolve");
+    if (!lua_isnil(L, -1))
+        easyhttp_lua_checkhostmap(L, -1);
+    lua_pop(L, 1);
+    lua_getfield(L, idx, "connect_to");
+    if (!lua_isnil(L, -1))
+        easyhttp_lua_checkhostmap(L, -1);
+    lua_pop(L, 1);
+    easyhttp_lua_checkfield(L, idx, "on_data", LUA_TFUNCTION);
+    easyhttp_lua_checkfield(L, idx, "on_progress", LUA_TFUNCTION);
+    lua_getfield(L, idx, "headers");
+    if (!lua_isnil(L, -1)) {
+        if (!lua_istable(L, -1)) {
+            *error = "headers must be a table";
+            return options;
+        }
+        lua_pushnil(L);
+        while (lua_next(L, -2)) {
+            //not luaL_checkstring, converting a key in place would break the traversal
+            if (!lua_isstring(L, -2) || !lua_isstring(L, -1))
+                luaL_error(L, "header names and values must be strings");
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+
+    //nothing below raises an error
+    if (body_reader) {
+        lua_getfield(L, idx, "body");
+        options.body_reader = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    if (form) {
+        lua_getfield(L, idx, "form");
+        options.form = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    options_getfield(resolve,            easyhttp_lua_tohostmap);
+    options_getfield(connect_to,         easyhttp_lua_tohostmap);
+    options_getfield(on_data,            easyhttp_lua_checkfunction);
+    options_getfield(on_progress,        easyhttp_lua_checkfunction);
+
+    lua_getfield(L, idx, "headers");
+    if (!lua_isnil(L, -1)) {
+        //request headers are sent alongside the default ones, curl only takes a single list
+        for (struct curl_slist *it = defaults->headers; it; it = it->next)
+            options.headers = curl_slist_append(options.headers, it->data);
+
+        lua_pushnil(L);
+        while (lua_next(L, -2)) {
+            //the buffer may keep its own values on the stack
+            int key = lua_gettop(L) - 1, value = lua_gettop(L);
+
+            luaL_Buffer header;
+            luaL_buffinit(L, &header);
+            lua_pushvalue(L, key);
+            luaL_addvalue(&header);
+            luaL_addlstring(&header, ": ", 2);
+            lua_pushvalue(L, value);
+            luaL_addvalue(&header);
+            luaL_pushresult(&header);
+            options.headers = curl_slist_append(options.headers, lua_tostring(L, -1));
+            lua_settop(L, key);
+        }
+    }
+    lua_pop(L, 1);
+
+    *error = 0;
+    return options;
+}
+
+static inline struct easyhttp_Options easyhttp_options_parse(lua_State *L, int idx, const char **error)
+{ return easyhttp_options_parse_from(L, idx, &EASYHTTP_DEFAULT_OPTIONS, error); }
 
-    *buffer = easyhttp_buffer_append(*buffer, size * nmemb, data);
-    if (!*buffer) {
-        return 0;
+static inline void easyhttp_options_set(struct easyhttp_Options options, CURL *curl)
+{
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, options.method);
+    //streamed and compressed bodies are set up by easyhttp_upload_setup
+    if (options.body && options.compress_body == EASYHTTP_COMPRESSION_NONE) {
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, options.body_length);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, options.body);
     }
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, (long)options.timeout);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, (long)options.follow_redirects);
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, (long)options.max_redirects);
+    if (options.http_version != CURL_HTTP_VERSION_NONE) {
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, options.http_version);
+        //wait for a connection which can multiplex rather than opening a new one for each concurrent transfer
+        if (options.http_version >= CURL_HTTP_VERSION_2_0)
+            curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    }
+    curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, options.dns_cache_timeout);
+    //curl decodes the body before it reaches the write callbacks, so everything past here sees the decoded size
+    if (options.accept_encoding)
+        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, options.accept_encoding);
+    //only catches bodies with a known length up front, the write callbacks check the rest
+    if (options.max_response_size > 0)
+        curl_easy_setopt(curl, CURLOPT_MAXFILESIZE_LARGE, (curl_off_t)options.max_response_size);
+
+    const struct easyhttp_Options *defaults = options.defaults ? options.defaults : &EASYHTTP_DEFAULT_OPTIONS;
+    if (options.headers || defaults->headers)
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, options.headers ? options.headers : defaults->headers);
+    //the entries end up in the (shared) DNS cache, so they also apply to later requests to the same host and port
+    if (options.resolve || defaults->resolve)
+        curl_easy_setopt(curl, CURLOPT_RESOLVE, options.resolve ? options.resolve : defaults->resolve);
+    if (options.connect_to || defaults->connect_to)
+        curl_easy_setopt(curl, CURLOPT_CONNECT_TO, options.connect_to ? options.connect_to : defaults->connect_to);
+}
 
-    return size * nmemb;
+//Releases what the parse allocated and referenced, references shared with the defaults belong to those
+static inline void easyhttp_options_free(lua_State *L, struct easyhttp_Options *options)
+{
+    const struct easyhttp_Options *defaults = options->defaults ? options->defaults : &EASYHTTP_DEFAULT_OPTIONS;
+    if (options->body_reader != defaults->body_reader)
+        luaL_unref(L, LUA_REGISTRYINDEX, options->body_reader);
+    if (options->form != defaults->form)
+        luaL_unref(L, LUA_REGISTRYINDEX, options->form);
+    if (options->on_data != defaults->on_data)
+        luaL_unref(L, LUA_REGISTRYINDEX, options->on_data);
+    if (options->on_progress != defaults->on_progress)
+        luaL_unref(L, LUA_REGISTRYINDEX, options->on_progress);
+
+    curl_slist_free_all(options->headers);
+    curl_slist_free_all(options->resolve);
+    curl_slist_free_all(options->connect_to);
+    //not zeroed, 0 is a valid reference
+    *options = EASYHTTP_DEFAULT_OPTIONS;
 }
+
 #pragma endregion
 
 #endif //EASYHTTP_COMMON_H
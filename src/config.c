@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) 2024 Amrit Bhogal
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include "config.h"
+#include "async.h"
+
+static struct easyhttp_Config config = {0};
+static mtx_t config_mutex;
+static once_flag config_once = ONCE_FLAG_INIT;
+
+static void config_init(void)
+{ mtx_init(&config_mutex, mtx_plain); }
+
+struct easyhttp_Config easyhttp_config_get(void)
+{
+    call_once(&config_once, config_init);
+
+    mtx_lock(&config_mutex);
+    struct easyhttp_Config copy = config;
+    mtx_unlock(&config_mutex);
+    return copy;
+}
+
+#define config_getfield(key) do {\
+    lua_getfield(L, 1, #key);\
+    if (!lua_isnil(L, -1)) {\
+        lua_Integer value = luaL_checkinteger(L, -1);\
+        luaL_argcheck(L, value >= 0, 1, #key " must not be negative");\
+        updated.key = (long)value;\
+    }\
+    lua_pop(L, 1);\
+} while(0)
+
+int easyhttp_configure(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+
+    struct easyhttp_Config updated = easyhttp_config_get();
+    config_getfield(max_concurrency);
+    config_getfield(max_per_host);
+    config_getfield(max_concurrent_streams);
+    //not a long, which is 32 bits on Windows
+    lua_getfield(L, 1, "memory_limit");
+    if (!lua_isnil(L, -1)) {
+        lua_Integer value = luaL_checkinteger(L, -1);
+        luaL_argcheck(L, value >= 0, 1, "memory_limit must not be negative");
+        updated.memory_limit = (size_t)value;
+    }
+    lua_pop(L, 1);
+    lua_getfield(L, 1, "memory_stats");
+    if (!lua_isnil(L, -1))
+        updated.memory_stats = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    lua_getfield(L, 1, "count_libcurl");
+    bool count_libcurl = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    //libcurl keeps its allocator until it is cleaned up, so this only works before the first request
+    if (count_libcurl) {
+        const char *err = easyhttp_memory_curl_init(true);
+        if (err)
+            return luaL_error(L, "%s", err);
+    }
+
+    mtx_lock(&config_mutex);
+    config = updated;
+    mtx_unlock(&config_mutex);
+
+    easyhttp_memory_set_limit(updated.memory_limit);
+    easyhttp_memory_set_stats(updated.memory_stats);
+    easyhttp_async_reconfigure();
+    return 0;
+}
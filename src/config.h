@@ -0,0 +1,46 @@
+// Copyright (c) 2024 Amrit Bhogal
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef EASYHTTP_CONFIG_H
+#define EASYHTTP_CONFIG_H
+
+#include "common.h"
+
+//Process-wide settings for the transfer engines, 0 means unlimited
+struct easyhttp_Config {
+    long max_concurrency; //async requests running at once, the rest wait in a FIFO queue
+    long max_per_host; //connections to a single host, transfers over the limit are queued by curl
+    long max_concurrent_streams; //HTTP/2 streams multiplexed over a single connection, 0 keeps curl's default
+    size_t memory_limit; //bytes easyhttp (and libcurl, with `count_libcurl`) may allocate, allocations over it fail
+    bool memory_stats; //count allocations, bytes and requests for `easyhttp.memory_stats`, off by default
+};
+
+//Applies the settings which are per multi handle
+static inline void easyhttp_config_apply(const struct easyhttp_Config *config, CURLM *multi)
+{
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, config->max_per_host);
+#if LIBCURL_VERSION_NUM >= 0x074300
+    if (config->max_concurrent_streams > 0)
+        curl_multi_setopt(multi, CURLMOPT_MAX_CONCURRENT_STREAMS, config->max_concurrent_streams);
+#endif
+}
+
+//Snapshot of the current settings, safe to call from any thread
+struct easyhttp_Config easyhttp_config_get(void);
+
+/*
+function easyhttp.configure(options: {
+    max_concurrency: integer?,
+    max_per_host: integer?,
+    max_concurrent_streams: integer?,
+    memory_limit: integer?,
+    memory_stats: boolean?,
+    count_libcurl: boolean?,
+})
+*/
+int easyhttp_configure(lua_State *L);
+
+#endif //EASYHTTP_CONFIG_H
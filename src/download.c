@@ -0,0 +1,359 @@
+/**
+ * Copyright (c) 2024 Amrit Bhogal
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include "download.h"
+#include "config.h"
+#include "file.h"
+#include "headers.h"
+#include "pool.h"
+#include "share.h"
+#include "transfer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <curl/curl.h>
+
+//A byte range of the file, fetched on its own handle and written through its own FILE* at its offset
+struct download_Part {
+    CURL *handle;
+    FILE *file;
+    curl_off_t start, length, received;
+    const char *error;
+};
+
+static size_t header_callback(char *buf, size_t size, size_t nmemb, void *userp)
+{
+    return easyhttp_headers_write(buf, size, nmemb, userp);
+}
+
+static size_t part_write(char *data, size_t size, size_t nmemb, void *userp)
+{
+    struct download_Part *part = userp;
+    size_t length = size * nmemb;
+
+    //a 200 means the range (or If-Range) was ignored, and the whole file is coming
+    if (part->received == 0) {
+        long status_code = 0;
+        curl_easy_getinfo(part->handle, CURLINFO_RESPONSE_CODE, &status_code);
+        if (status_code != 206) {
+            part->error = status_code == 200 ? "the file changed on the server during the download" : "range request failed";
+            return 0;
+        }
+    }
+    if (part->received + (curl_off_t)length > part->length) {
+        part->error = "server sent more than the requested range";
+        return 0;
+    }
+
+    if (fwrite(data, 1, length, part->file) != length) {
+        part->error = "failed to write to file";
+        return 0;
+    }
+    part->received += length;
+    return length;
+}
+
+//Downloads are always plain GET (or HEAD) requests, so everything which would send a body is dropped.
+//Only the connection and header options apply, the body goes to the file byte for byte.
+//Ranges of an encoded body can't be decoded on their own, so downloads never ask for one either
+static void download_options_get(lua_State *L, struct easyhttp_Options *options)
+{
+    const struct easyhttp_Options *defaults = options->defaults ? options->defaults : &EASYHTTP_DEFAULT_OPTIONS;
+    if (options->body_reader != defaults->body_reader)
+        luaL_unref(L, LUA_REGISTRYINDEX, options->body_reader);
+    if (options->form != defaults->form)
+        luaL_unref(L, LUA_REGISTRYINDEX, options->form);
+    //unreferencing LUA_NOREF does nothing, so options_free leaves the defaults' references alone
+    options->body_reader = options->form = LUA_NOREF;
+    options->body = options->body_file = NULL;
+    options->body_length = -1;
+    options->compress_body = EASYHTTP_COMPRESSION_NONE;
+    options->method = "GET";
+    options->accept_encoding = NULL;
+}
+
+//A handle for `url` with the request options
+static CURL *download_handle(struct easyhttp_Share *share, const struct easyhttp_Options *options, const char *url)
+{
+    CURL *handle = easyhttp_pool_handle_acquire();
+    if (!handle)
+        return NULL;
+    easyhttp_share_attach(share, handle);
+    easyhttp_options_set(*options, handle);
+    curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, NULL);
+    curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(handle, CURLOPT_URL, url);
+    return handle;
+}
+
+//Streams the whole body into `path` on a single connection, takes ownership of `options`
+static int download_single(lua_State *L, struct easyhttp_Options options, const char *url, const char *path)
+{
+    //with `resume`, whatever an earlier attempt left in the file is kept
+    FILE *file = fopen(path, options.resume ? "ab" : "wb");
+    if (!file) {
+        easyhttp_options_free(L, &options);
+        lua_pushnil(L);
+        lua_pushfstring(L, "failed to open '%s'", path);
+        return 2;
+    }
+
+    CURL *handle = easyhttp_pool_handle_acquire();
+    if (!handle) {
+        fclose(file);
+        easyhttp_options_free(L, &options);
+        lua_pushnil(L);
+        lua_pushliteral(L, "failed to create curl handle");
+        return 2;
+    }
+    easyhttp_share_attach(easyhttp_share_state(L), handle);
+
+    options.output_file = &file;
+    int nret = easyhttp_transfer_perform(L, handle, url, options);
+    easyhttp_pool_handle_release(handle);
+
+    if (fclose(file) != 0 && nret == 3) {
+        lua_pop(L, 3);
+        lua_pushnil(L);
+        lua_pushliteral(L, "failed to perform request: failed to write to file");
+        return 2;
+    }
+    return nret;
+}
+
+//download_single with the number of parts (1) after the response
+static int download_single_counted(lua_State *L, struct easyhttp_Options options, const char *url, const char *path)
+{
+    int nret = download_single(L, options, url, path);
+    if (nret != 3)
+        return nret;
+    lua_pushinteger(L, 1);
+    return 4;
+}
+
+//Creates `path` at its full size, so every part can be written at its offset
+static bool preallocate(const char *path, curl_off_t length)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return false;
+    bool ok = easyhttp_file_seek(file, length - 1, SEEK_SET) == 0 && fputc(0, file) != EOF;
+    return fclose(file) == 0 && ok;
+}
+
+//Fetches `count` ranges of `url` in parallel on one multi handle, `headers` already has the If-Range validator
+static const char *download_parts(struct easyhttp_Share *share, const struct easyhttp_Options *options, const char *url,
+                                  struct curl_slist *headers, const char *path, curl_off_t length, struct download_Part *parts, size_t count)
+{
+    if (!preallocate(path, length))
+        return "failed to create the file";
+
+    CURLM *multi = curl_multi_init();
+    if (!multi)
+        return "failed to create multi handle";
+    struct easyhttp_Config config = easyhttp_config_get();
+    easyhttp_config_apply(&config, multi);
+
+    const char *err = NULL;
+    curl_off_t part_size = length / (curl_off_t)count;
+    for (size_t i = 0; i < count && !err; i++) {
+        struct download_Part *part = &parts[i];
+        part->start = (curl_off_t)i * part_size;
+        part->length = i + 1 == count ? length - part->start : part_size;
+
+        part->file = fopen(path, "r+b");
+        if (!part->file || easyhttp_file_seek(part->file, part->start, SEEK_SET) != 0) {
+            err = "failed to open the file";
+            break;
+        }
+
+        part->handle = download_handle(share, options, url);
+        if (!part->handle) {
+            err = "failed to create curl handle";
+            break;
+        }
+
+        char range[64];
+        snprintf(range, sizeof(range), "%" CURL_FORMAT_CURL_OFF_T "-%" CURL_FORMAT_CURL_OFF_T, part->start, part->start + part->length - 1);
+        curl_easy_setopt(part->handle, CURLOPT_RANGE, range);
+        if (headers)
+            curl_easy_setopt(part->handle, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(part->handle, CURLOPT_WRITEFUNCTION, part_write);
+        curl_easy_setopt(part->handle, CURLOPT_WRITEDATA, part);
+        curl_easy_setopt(part->handle, CURLOPT_PRIVATE, part);
+
+        if (curl_multi_add_handle(multi, part->handle) != CURLM_OK)
+            err = "failed to add request to multi handle";
+    }
+
+    //the first part to fail stops the rest, the file is useless without it
+    int running = 0;
+    while (!err) {
+        CURLMcode mc = curl_multi_perform(multi, &running);
+        if (mc != CURLM_OK) {
+            err = curl_multi_strerror(mc);
+            break;
+        }
+
+        CURLMsg *msg = NULL;
+        int queued = 0;
+        while (!err && (msg = curl_multi_info_read(multi, &queued))) {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            struct download_Part *part = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&part);
+            if (msg->data.result != CURLE_OK)
+                err = part->error ? part->error : curl_easy_strerror(msg->data.result);
+            else if (part->received != part->length)
+                err = "server sent less than the requested range";
+        }
+
+        if (err || !running)
+            break;
+        mc = curl_multi_poll(multi, NULL, 0, 1000, NULL);
+        if (mc != CURLM_OK)
+            err = curl_multi_strerror(mc);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (parts[i].handle) {
+            curl_multi_remove_handle(multi, parts[i].handle);
+            easyhttp_pool_handle_release(parts[i].handle);
+        }
+        if (parts[i].file && fclose(parts[i].file) != 0 && !err)
+            err = "failed to write to file";
+    }
+    curl_multi_cleanup(multi);
+
+    if (err)
+        remove(path);
+    return err;
+}
+
+int easyhttp_download(lua_State *L)
+{
+    easyhttp_memory_curl_check(L);
+    const char *url = luaL_checkstring(L, 1), *path = luaL_checkstring(L, 2);
+    if (lua_isnoneornil(L, 3)) {
+        lua_settop(L, 2);
+        lua_newtable(L);
+    } else {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        lua_settop(L, 3);
+    }
+
+    lua_getfield(L, 3, "parts");
+    lua_Integer max_parts = luaL_optinteger(L, -1, EASYHTTP_DOWNLOAD_DEFAULT_PARTS);
+    lua_pop(L, 1);
+    luaL_argcheck(L, max_parts >= 1, 3, "parts must be at least 1");
+    lua_getfield(L, 3, "min_part_size");
+    lua_Integer min_part_size = luaL_optinteger(L, -1, EASYHTTP_DOWNLOAD_MIN_PART_SIZE);
+    lua_pop(L, 1);
+    luaL_argcheck(L, min_part_size >= 1, 3, "min_part_size must be at least 1");
+
+    const char *err = NULL;
+    struct easyhttp_Options options = easyhttp_options_parse(L, 3, &err);
+    if (err) {
+        easyhttp_options_free(L, &options);
+        lua_pushnil(L);
+        lua_pushstring(L, err);
+        return 2;
+    }
+    download_options_get(L, &options);
+
+    //the parts of a parallel download can't be told apart in a partial file, so resuming is always a single stream.
+    //A single stream is counted as a request by the transfer itself
+    if (options.resume)
+        return download_single_counted(L, options, url, path);
+
+    //HEAD for the size, the url after any redirects and whether the server takes ranges
+    struct easyhttp_Headers *headers = easyhttp_headers_create();
+    struct easyhttp_Share *share = easyhttp_share_state(L);
+    CURL *probe = headers ? download_handle(share, &options, url) : NULL;
+    if (!probe) {
+        easyhttp_headers_free(&headers);
+        easyhttp_options_free(L, &options);
+        lua_pushnil(L);
+        lua_pushliteral(L, "failed to create curl handle");
+        return 2;
+    }
+    curl_easy_setopt(probe, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(probe, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(probe, CURLOPT_HEADERDATA, headers);
+
+    CURLcode res = curl_easy_perform(probe);
+    long status_code = 0;
+    curl_off_t length = -1;
+    char *effective_url = NULL;
+    if (res == CURLE_OK) {
+        curl_easy_getinfo(probe, CURLINFO_RESPONSE_CODE, &status_code);
+        curl_easy_getinfo(probe, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+        curl_easy_getinfo(probe, CURLINFO_EFFECTIVE_URL, &effective_url);
+        effective_url = effective_url ? string_duplicate(effective_url) : NULL;
+    }
+    easyhttp_pool_handle_release(probe);
+
+    const struct easyhttp_Header *accept_ranges = easyhttp_headers_find(headers, "Accept-Ranges", sizeof("Accept-Ranges") - 1);
+    curl_off_t count = length / (curl_off_t)min_part_size;
+    if (count > max_parts)
+        count = max_parts;
+
+    //the parts are tied to the file with If-Range, a changed file makes the server answer with the whole new one instead
+    //of mixing ranges of both. Weak ETags can't be used for it, so the date it was last modified is the fallback
+    const struct easyhttp_Header *validator = easyhttp_headers_find(headers, "ETag", sizeof("ETag") - 1);
+    if (validator && strncmp(validator->value, "W/", 2) == 0)
+        validator = NULL;
+    if (!validator)
+        validator = easyhttp_headers_find(headers, "Last-Modified", sizeof("Last-Modified") - 1);
+
+    //servers which don't say they take ranges (or which HEAD doesn't work on) get a single stream,
+    //as do files which can't be validated
+    if (res != CURLE_OK || status_code != 200 || !effective_url || count < 2
+        || !accept_ranges || !strstr(accept_ranges->value, "bytes") || !validator) {
+        easyhttp_free(effective_url);
+        easyhttp_headers_free(&headers);
+        return download_single_counted(L, options, url, path);
+    }
+
+    const struct easyhttp_Options *defaults = options.defaults ? options.defaults : &EASYHTTP_DEFAULT_OPTIONS;
+    struct curl_slist *request_headers = NULL;
+    for (struct curl_slist *it = options.headers ? options.headers : defaults->headers; it; it = it->next)
+        request_headers = curl_slist_append(request_headers, it->data);
+    luaL_Buffer if_range;
+    luaL_buffinit(L, &if_range);
+    luaL_addstring(&if_range, "If-Range: ");
+    luaL_addlstring(&if_range, validator->value, validator->value_length);
+    luaL_pushresult(&if_range);
+    request_headers = curl_slist_append(request_headers, lua_tostring(L, -1));
+    lua_pop(L, 1);
+
+    easyhttp_memory_count_request();
+    struct download_Part *parts = easyhttp_calloc((size_t)count, sizeof(struct download_Part));
+    err = parts ? download_parts(share, &options, effective_url, request_headers, path, length, parts, (size_t)count)
+                : "failed to allocate memory for the download";
+
+    easyhttp_free(parts);
+    curl_slist_free_all(request_headers);
+    easyhttp_free(effective_url);
+    easyhttp_options_free(L, &options);
+
+    if (err) {
+        easyhttp_headers_free(&headers);
+        lua_pushnil(L);
+        lua_pushfstring(L, "failed to download: %s", err);
+        return 2;
+    }
+
+    lua_pushboolean(L, 1);
+    lua_pushinteger(L, status_code);
+    easyhttp_headers_push(L, headers);
+    easyhttp_headers_free(&headers);
+    lua_pushinteger(L, (lua_Integer)count);
+    return 4;
+}
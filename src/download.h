@@ -0,0 +1,20 @@
+// Copyright (c) 2024 Amrit Bhogal
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef EASYHTTP_DOWNLOAD_H
+#define EASYHTTP_DOWNLOAD_H
+
+#include "common.h"
+
+#define EASYHTTP_DOWNLOAD_DEFAULT_PARTS 4
+//smaller parts spend more on their own round trips than they gain from running in parallel, `min_part_size` overrides it
+#define EASYHTTP_DOWNLOAD_MIN_PART_SIZE ((curl_off_t)1024 * 1024)
+
+/*
+function easyhttp.download(url: string, path: string, options: easyhttp.DownloadOptions?): (true, integer status_code, { [string]: string } headers, integer parts) | (nil, string error)
+*/
+int easyhttp_download(lua_State *L);
+
+#endif //EASYHTTP_DOWNLOAD_H
@@ -0,0 +1,56 @@
+// Copyright (c) 2024 Amrit Bhogal
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef EASYHTTP_FILE_H
+#define EASYHTTP_FILE_H
+
+#include "common.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#   include <io.h>
+#else
+#   include <unistd.h>
+#   include <sys/types.h>
+#endif
+
+//fseek and ftell only take a long, which is 32 bits on Windows, downloads and uploaded files can be larger than that.
+//32 bit POSIX builds also need _FILE_OFFSET_BITS=64 (see the rockspec) for off_t to be 64 bits
+
+static inline int easyhttp_file_seek(FILE *file, curl_off_t offset, int origin)
+{
+#ifdef _WIN32
+    return _fseeki64(file, offset, origin);
+#else
+    return fseeko(file, (off_t)offset, origin);
+#endif
+}
+
+static inline curl_off_t easyhttp_file_tell(FILE *file)
+{
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return ftello(file);
+#endif
+}
+
+//Empties the file and moves back to its start, returns false on failure
+static inline bool easyhttp_file_truncate(FILE *file)
+{
+    if (fflush(file) != 0)
+        return false;
+#ifdef _WIN32
+    if (_chsize_s(_fileno(file), 0) != 0)
+        return false;
+#else
+    if (ftruncate(fileno(file), 0) != 0)
+        return false;
+#endif
+    return easyhttp_file_seek(file, 0, SEEK_SET) == 0;
+}
+
+#endif //EASYHTTP_FILE_H
@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2024 Amrit Bhogal
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include "form.h"
+
+#include <curl/curl.h>
+
+//`name` is used unless the part table names itself
+static CURLcode add_part(lua_State *L, curl_mime *mime, const char *name, int value)
+{
+    curl_mimepart *part = curl_mime_addpart(mime);
+    if (!part)
+        return CURLE_OUT_OF_MEMORY;
+
+    size_t length = 0;
+    if (lua_type(L, value) == LUA_TSTRING) {
+        const char *data = lua_tolstring(L, value, &length);
+        CURLcode res = curl_mime_name(part, name);
+        return res != CURLE_OK ? res : curl_mime_data(part, data, length);
+    }
+
+    CURLcode res = CURLE_OK;
+    lua_getfield(L, value, "name");
+    if (!lua_isnil(L, -1))
+        name = lua_tostring(L, -1);
+    res = curl_mime_name(part, name);
+    lua_pop(L, 1);
+
+    //files are streamed from disk, and named after their basename unless `filename` is given
+    lua_getfield(L, value, "path");
+    if (res == CURLE_OK && !lua_isnil(L, -1))
+        res = curl_mime_filedata(part, lua_tostring(L, -1));
+    lua_pop(L, 1);
+
+    lua_getfield(L, value, "data");
+    if (res == CURLE_OK && !lua_isnil(L, -1)) {
+        const char *data = lua_tolstring(L, -1, &length);
+        res = curl_mime_data(part, data, length);
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, value, "type");
+    if (res == CURLE_OK && !lua_isnil(L, -1))
+        res = curl_mime_type(part, lua_tostring(L, -1));
+    lua_pop(L, 1);
+
+    lua_getfield(L, value, "filename");
+    if (res == CURLE_OK && !lua_isnil(L, -1))
+        res = curl_mime_filename(part, lua_tostring(L, -1));
+    lua_pop(L, 1);
+
+    return res;
+}
+
+curl_mime *easyhttp_form_build(lua_State *L, LuaReference_t form, CURL *handle, const char **error)
+{
+    curl_mime *mime = curl_mime_init(handle);
+    if (!mime) {
+        *error = "failed to create form";
+        return NULL;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, form);
+    int idx = lua_gettop(L);
+
+    CURLcode res = CURLE_OK;
+    lua_pushnil(L);
+    while (res == CURLE_OK && lua_next(L, idx)) {
+        //list entries always have a `name`, and lua_tostring would change the key under lua_next
+        const char *name = lua_type(L, -2) == LUA_TSTRING ? lua_tostring(L, -2) : NULL;
+        res = add_part(L, mime, name, lua_gettop(L));
+        lua_pop(L, 1);
+    }
+    lua_settop(L, idx - 1);
+
+    if (res != CURLE_OK) {
+        curl_mime_free(mime);
+        //curl checks that files can be read when they are added
+        *error = res == CURLE_READ_ERROR ? "failed to open form file" : curl_easy_strerror(res);
+        return NULL;
+    }
+
+    *error = NULL;
+    return mime;
+}
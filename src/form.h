@@ -0,0 +1,15 @@
+// Copyright (c) 2024 Amrit Bhogal
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef EASYHTTP_FORM_H
+#define EASYHTTP_FORM_H
+
+#include "common.h"
+
+//Builds the multipart body for the `form` table checked by easyhttp_lua_checkform. Strings are copied,
+//files are only opened once curl sends them. The result is freed with curl_mime_free after the transfer
+curl_mime *easyhttp_form_build(lua_State *L, LuaReference_t form, CURL *handle, const char **error);
+
+#endif //EASYHTTP_FORM_H
@@ -0,0 +1,262 @@
+/**
+ * Copyright (c) 2024 Amrit Bhogal
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include "headers.h"
+#include "pool.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct easyhttp_Headers *easyhttp_headers_create(void)
+{
+    struct easyhttp_Headers *headers = easyhttp_pool_take(EASYHTTP_POOL_HEADERS);
+    if (!headers)
+        headers = easyhttp_malloc(sizeof(struct easyhttp_Headers));
+    if (!headers) return NULL;
+
+    headers->length = headers->cap = 0;
+    headers->headers = NULL;
+    headers->cursor = headers->initial_block;
+    headers->end = headers->initial_block + sizeof(headers->initial_block);
+    headers->blocks = NULL;
+    return headers;
+}
+
+void easyhttp_headers_free(struct easyhttp_Headers **headers)
+{
+    if (!headers || !*headers) return;
+    for (struct easyhttp_HeaderBlock *it = (*headers)->blocks, *next; it; it = next) {
+        next = it->next;
+        easyhttp_free(it);
+    }
+
+    if (!easyhttp_pool_give(EASYHTTP_POOL_HEADERS, *headers))
+        easyhttp_free(*headers);
+    *headers = NULL;
+}
+
+static void *arena_alloc(struct easyhttp_Headers *headers, size_t size, size_t align)
+{
+    uintptr_t cursor = ((uintptr_t)headers->cursor + align - 1) & ~(uintptr_t)(align - 1);
+    if (cursor <= (uintptr_t)headers->end && size <= (uintptr_t)headers->end - cursor) {
+        headers->cursor = (char *)cursor + size;
+        return (void *)cursor;
+    }
+
+    //oversized requests get a block of their own, so the rest of the current block isn't wasted on them
+    bool dedicated = size + align > EASYHTTP_HEADERS_ARENA_SIZE / 4;
+    size_t block_size = dedicated ? size + align : EASYHTTP_HEADERS_ARENA_SIZE;
+    if (block_size > SIZE_MAX - sizeof(struct easyhttp_HeaderBlock))
+        return NULL;
+    struct easyhttp_HeaderBlock *block = easyhttp_malloc(sizeof(struct easyhttp_HeaderBlock) + block_size);
+    if (!block)
+        return NULL;
+    block->next = headers->blocks;
+    headers->blocks = block;
+
+    cursor = ((uintptr_t)block->data + align - 1) & ~(uintptr_t)(align - 1);
+    if (!dedicated) {
+        headers->cursor = (char *)cursor + size;
+        headers->end = block->data + block_size;
+    }
+    return (void *)cursor;
+}
+
+bool easyhttp_headers_append(struct easyhttp_Headers *headers, size_t key_length, const char key[static key_length],
+                             size_t value_length, const char value[static value_length])
+{
+    if (headers->length == headers->cap) {
+        //the old array stays in the arena, growing geometrically bounds the waste to the size of the final one
+        size_t cap = headers->cap ? headers->cap * 2 : 32;
+        struct easyhttp_Header *entries = arena_alloc(headers, cap * sizeof(struct easyhttp_Header), alignof(struct easyhttp_Header));
+        if (!entries)
+            return false;
+        if (headers->length)
+            memcpy(entries, headers->headers, headers->length * sizeof(struct easyhttp_Header));
+        headers->headers = entries;
+        headers->cap = cap;
+    }
+
+    char *data = arena_alloc(headers, key_length + value_length + 2, 1);
+    if (!data)
+        return false;
+    memcpy(data, key, key_length);
+    data[key_length] = '\0';
+    memcpy(data + key_length + 1, value, value_length);
+    data[key_length + 1 + value_length] = '\0';
+
+    headers->headers[headers->length++] = (struct easyhttp_Header) {
+        .key = data,
+        .key_length = key_length,
+        .value = data + key_length + 1,
+        .value_length = value_length
+    };
+    return true;
+}
+
+size_t easyhttp_headers_write(char *buf, size_t size, size_t nmemb, struct easyhttp_Headers *headers)
+{
+    size_t length = size * nmemb;
+    const char *colon = memchr(buf, ':', length);
+    if (!colon)
+        return length;
+
+    const char *value = colon + 1, *end = buf + length;
+    while (value < end && (*value == ' ' || *value == '\t')) value++;
+    while (end > value && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) end--;
+
+    if (!easyhttp_headers_append(headers, (size_t)(colon - buf), buf, (size_t)(end - value), value))
+        return 0;
+    return length;
+}
+
+void easyhttp_headers_push(lua_State *L, const struct easyhttp_Headers *headers)
+{
+    lua_createtable(L, 0, (int)headers->length);
+    for (size_t i = 0; i < headers->length; i++) {
+        lua_pushlstring(L, headers->headers[i].key, headers->headers[i].key_length);
+        lua_pushlstring(L, headers->headers[i].value, headers->headers[i].value_length);
+        lua_rawset(L, -3);
+    }
+}
+
+void easyhttp_headers_push_object(lua_State *L, struct easyhttp_Headers *headers, int owner)
+{
+    if (owner) owner = lua_absindex(L, owner);
+
+    struct easyhttp_HeadersObject *object = lua_newuserdata(L, sizeof(struct easyhttp_HeadersObject));
+    *object = (struct easyhttp_HeadersObject) { .headers = headers, .owned = owner == 0 };
+    luaL_setmetatable(L, EASYHTTP_HEADERS_TNAME);
+
+    if (owner) {
+        //5.1 only takes tables as uservalues
+        lua_createtable(L, 1, 0);
+        lua_pushvalue(L, owner);
+        lua_rawseti(L, -2, 1);
+        lua_setuservalue(L, -2);
+    }
+}
+
+static struct easyhttp_Headers *check_headers(lua_State *L, int idx)
+{
+    struct easyhttp_HeadersObject *object = luaL_checkudata(L, idx, EASYHTTP_HEADERS_TNAME);
+    if (!object->headers)
+        luaL_error(L, "attempt to use freed headers");
+    return object->headers;
+}
+
+//header names are ASCII and compared case-insensitively, the locale must not matter
+static bool name_equals(const struct easyhttp_Header *header, const char *name, size_t length)
+{
+    if (header->key_length != length)
+        return false;
+    for (size_t i = 0; i < length; i++) {
+        char a = header->key[i], b = name[i];
+        if (a >= 'A' && a <= 'Z') a += 'a' - 'A';
+        if (b >= 'A' && b <= 'Z') b += 'a' - 'A';
+        if (a != b) return false;
+    }
+    return true;
+}
+
+const struct easyhttp_Header *easyhttp_headers_find(const struct easyhttp_Headers *headers, const char *name, size_t length)
+{
+    //the last one wins, same as with the table
+    for (size_t i = headers->length; i-- > 0;) {
+        if (name_equals(&headers->headers[i], name, length))
+            return &headers->headers[i];
+    }
+    return NULL;
+}
+
+int easyhttp_headers_get(lua_State *L)
+{
+    struct easyhttp_Headers *headers = check_headers(L, 1);
+    size_t length = 0;
+    const char *name = luaL_checklstring(L, 2, &length);
+
+    const struct easyhttp_Header *header = easyhttp_headers_find(headers, name, length);
+    if (header)
+        lua_pushlstring(L, header->value, header->value_length);
+    else
+        lua_pushnil(L);
+    return 1;
+}
+
+int easyhttp_headers_get_all(lua_State *L)
+{
+    struct easyhttp_Headers *headers = check_headers(L, 1);
+    size_t length = 0;
+    const char *name = luaL_checklstring(L, 2, &length);
+
+    lua_newtable(L);
+    lua_Integer n = 0;
+    for (size_t i = 0; i < headers->length; i++) {
+        if (name_equals(&headers->headers[i], name, length)) {
+            lua_pushlstring(L, headers->headers[i].value, headers->headers[i].value_length);
+            lua_rawseti(L, -2, ++n);
+        }
+    }
+    return 1;
+}
+
+static int headers_next(lua_State *L)
+{
+    struct easyhttp_Headers *headers = check_headers(L, lua_upvalueindex(1));
+    lua_Integer i = lua_tointeger(L, lua_upvalueindex(2));
+    if ((size_t)i >= headers->length)
+        return 0;
+
+    lua_pushinteger(L, i + 1);
+    lua_replace(L, lua_upvalueindex(2));
+    lua_pushlstring(L, headers->headers[i].key, headers->headers[i].key_length);
+    lua_pushlstring(L, headers->headers[i].value, headers->headers[i].value_length);
+    return 2;
+}
+
+int easyhttp_headers_pairs(lua_State *L)
+{
+    check_headers(L, 1);
+    lua_pushvalue(L, 1);
+    lua_pushinteger(L, 0);
+    lua_pushcclosure(L, headers_next, 2);
+    return 1;
+}
+
+int easyhttp_headers__index(lua_State *L)
+{
+    check_headers(L, 1);
+
+    //methods take precedence, `:get` reaches headers which share their names
+    if (lua_type(L, 2) == LUA_TSTRING) {
+        luaL_getmetatable(L, EASYHTTP_HEADERS_TNAME);
+        lua_getfield(L, -1, "methods");
+        lua_pushvalue(L, 2);
+        lua_rawget(L, -2);
+        if (!lua_isnil(L, -1))
+            return 1;
+        lua_pop(L, 3);
+    }
+
+    return easyhttp_headers_get(L);
+}
+
+int easyhttp_headers__len(lua_State *L)
+{
+    lua_pushinteger(L, check_headers(L, 1)->length);
+    return 1;
+}
+
+int easyhttp_headers__gc(lua_State *L)
+{
+    struct easyhttp_HeadersObject *object = luaL_checkudata(L, 1, EASYHTTP_HEADERS_TNAME);
+    if (object->owned)
+        easyhttp_headers_free(&object->headers);
+    object->headers = NULL;
+    return 0;
+}
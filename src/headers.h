@@ -0,0 +1,79 @@
+// Copyright (c) 2024 Amrit Bhogal
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef EASYHTTP_HEADERS_H
+#define EASYHTTP_HEADERS_H
+
+#include "common.h"
+
+//Enough for a typical response's header lines and entries without any further allocation
+#define EASYHTTP_HEADERS_ARENA_SIZE ((size_t)4096)
+
+//Both slices point into the arena of the headers they belong to, and are NUL terminated
+struct easyhttp_Header {
+    const char *key, *value;
+    size_t key_length, value_length;
+};
+
+struct easyhttp_HeaderBlock {
+    struct easyhttp_HeaderBlock *next;
+    char data[];
+};
+
+//Response headers, everything is bump allocated out of a per-response arena which is freed all at once
+struct easyhttp_Headers {
+    size_t length, cap;
+    struct easyhttp_Header *headers;
+
+    //the arena starts in `initial_block`, and continues in blocks chained through `blocks` once that is full
+    char *cursor, *end;
+    struct easyhttp_HeaderBlock *blocks;
+    char initial_block[EASYHTTP_HEADERS_ARENA_SIZE];
+};
+
+struct easyhttp_Headers *easyhttp_headers_create(void);
+void easyhttp_headers_free(struct easyhttp_Headers **headers);
+
+//Adds a header, copying the key and value into the arena. Returns false if it could not be allocated
+bool easyhttp_headers_append(struct easyhttp_Headers *headers, size_t key_length, const char key[static key_length],
+                             size_t value_length, const char value[static value_length]);
+
+//CURLOPT_HEADERFUNCTION compatible, lines without a colon (status lines, the final blank line) are skipped
+size_t easyhttp_headers_write(char *buf, size_t size, size_t nmemb, struct easyhttp_Headers *headers);
+
+//The last header named `name` (compared case-insensitively), NULL if there is none
+const struct easyhttp_Header *easyhttp_headers_find(const struct easyhttp_Headers *headers, const char *name, size_t length);
+
+//Pushes a { [key] = value } table, later headers with the same key replace earlier ones
+void easyhttp_headers_push(lua_State *L, const struct easyhttp_Headers *headers);
+
+//Headers handed to Lua as-is, looked up on demand instead of being turned into a table
+#define EASYHTTP_HEADERS_TNAME "easyhttp.Headers"
+struct easyhttp_HeadersObject {
+    struct easyhttp_Headers *headers;
+    bool owned; //otherwise the headers belong to the value kept in the uservalue
+};
+
+//Pushes a Headers value for `headers`. If `owner` is 0 the value takes ownership of the headers,
+//else the value at `owner` is kept alive for as long as the Headers value is.
+void easyhttp_headers_push_object(lua_State *L, struct easyhttp_Headers *headers, int owner);
+
+/*
+function easyhttp.Headers:get(name: string): string?
+*/
+int easyhttp_headers_get(lua_State *L);
+/*
+function easyhttp.Headers:get_all(name: string): { string }
+*/
+int easyhttp_headers_get_all(lua_State *L);
+/*
+function easyhttp.Headers:pairs(): (function(): (string, string)?)
+*/
+int easyhttp_headers_pairs(lua_State *L);
+int easyhttp_headers__index(lua_State *L);
+int easyhttp_headers__len(lua_State *L);
+int easyhttp_headers__gc(lua_State *L);
+
+#endif //EASYHTTP_HEADERS_H
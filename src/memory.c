@@ -0,0 +1,351 @@
+/**
+ * Copyright (c) 2024 Amrit Bhogal
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include "memory.h"
+#include "common.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <curl/curl.h>
+
+//Every allocation is prefixed with its size, so frees can be counted without asking the system allocator
+typedef union {
+    struct {
+        size_t size;
+        bool counted; //made while accounting was on, so freeing it is counted too
+    };
+    max_align_t align;
+} AllocationHeader_t;
+
+//Allocations happen on the Lua threads and the event loop at once, so the counters are lock-free where atomics are available
+#ifndef __STDC_NO_ATOMICS__
+#   include <stdatomic.h>
+typedef atomic_size_t Counter_t;
+#   define counter_load(c)              atomic_load_explicit(&(c), memory_order_relaxed)
+#   define counter_store(c, v)          atomic_store_explicit(&(c), (v), memory_order_relaxed)
+#   define counter_add(c, n)            ((void)atomic_fetch_add_explicit(&(c), (n), memory_order_relaxed))
+#   define counter_sub(c, n)            ((void)atomic_fetch_sub_explicit(&(c), (n), memory_order_relaxed))
+//Replaces `*expected` with `desired` if it is still current, else loads the current value into `*expected`
+#   define counter_replace(c, expected, desired) \
+        atomic_compare_exchange_weak_explicit(&(c), (expected), (desired), memory_order_relaxed, memory_order_relaxed)
+typedef atomic_bool Flag_t;
+#   define flag_load(f)                 atomic_load_explicit(&(f), memory_order_relaxed)
+#   define flag_store(f, v)             atomic_store_explicit(&(f), (v), memory_order_relaxed)
+#else
+typedef size_t Counter_t;
+typedef bool Flag_t;
+static mtx_t counter_mutex;
+static once_flag counter_once = ONCE_FLAG_INIT;
+
+static void counter_init(void)
+{ mtx_init(&counter_mutex, mtx_plain); }
+
+static size_t counter_exchange_add(Counter_t *counter, size_t add, size_t sub, bool store)
+{
+    call_once(&counter_once, counter_init);
+    mtx_lock(&counter_mutex);
+    size_t old = *counter;
+    *counter = store ? add : old + add - sub;
+    mtx_unlock(&counter_mutex);
+    return old;
+}
+
+static bool counter_replace_locked(Counter_t *counter, size_t *expected, size_t desired)
+{
+    call_once(&counter_once, counter_init);
+    mtx_lock(&counter_mutex);
+    bool replaced = *counter == *expected;
+    if (replaced)
+        *counter = desired;
+    else
+        *expected = *counter;
+    mtx_unlock(&counter_mutex);
+    return replaced;
+}
+
+#   define counter_load(c)              counter_exchange_add(&(c), 0, 0, false)
+#   define counter_store(c, v)          ((void)counter_exchange_add(&(c), (v), 0, true))
+#   define counter_add(c, n)            ((void)counter_exchange_add(&(c), (n), 0, false))
+#   define counter_sub(c, n)            ((void)counter_exchange_add(&(c), 0, (n), false))
+#   define counter_replace(c, expected, desired) counter_replace_locked(&(c), (expected), (desired))
+#   define flag_load(f)                 (f)
+#   define flag_store(f, v)             ((f) = (v))
+#endif
+
+//Nothing is counted unless `configure` asks for stats or a limit, then every allocation costs a few atomic updates
+static Flag_t stats_enabled, accounting;
+static Counter_t current, peak, allocations, allocated, failed, requests, limit;
+//Response body segments in use, the collector is paced on these. They are counted per segment, not per allocation
+static Counter_t buffered, gc_paced;
+
+static void accounting_update(void)
+{
+    bool enabled = flag_load(stats_enabled) || counter_load(limit) > 0;
+    //the peak is only tracked from here on
+    if (enabled && !flag_load(accounting))
+        counter_store(peak, counter_load(current));
+    flag_store(accounting, enabled);
+}
+
+//Reserves `grow` more bytes (after releasing `shrink`), returns false if that would go over the limit
+static bool stats_update(size_t grow, size_t shrink, bool allocation)
+{
+    //giving back what a failed allocation reserved must not be refused
+    size_t max = counter_load(limit), now = 0;
+    if (max > 0 && allocation && grow > shrink) {
+        size_t old = counter_load(current);
+        do {
+            if (grow - shrink > max || old > max - (grow - shrink)) {
+                counter_add(failed, 1);
+                return false;
+            }
+        } while (!counter_replace(current, &old, old + grow - shrink));
+        now = old + grow - shrink;
+    } else {
+        if (grow > 0) counter_add(current, grow);
+        if (shrink > 0) counter_sub(current, shrink);
+    }
+
+    if (allocation) {
+        counter_add(allocations, 1);
+        counter_add(allocated, grow);
+    }
+    if (grow > shrink) {
+        if (now == 0)
+            now = counter_load(current);
+        size_t old_peak = counter_load(peak);
+        while (now > old_peak && !counter_replace(peak, &old_peak, now));
+    }
+    return true;
+}
+
+void *easyhttp_malloc(size_t size)
+{
+    if (size > SIZE_MAX - sizeof(AllocationHeader_t))
+        return NULL;
+    bool counted = flag_load(accounting);
+    if (counted && !stats_update(size, 0, true))
+        return NULL;
+
+    AllocationHeader_t *header = malloc(sizeof(AllocationHeader_t) + size);
+    if (!header) {
+        if (counted) stats_update(0, size, false);
+        return NULL;
+    }
+    header->size = size;
+    header->counted = counted;
+    return header + 1;
+}
+
+void *easyhttp_calloc(size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size)
+        return NULL;
+
+    void *ptr = easyhttp_malloc(count * size);
+    if (ptr)
+        memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void *easyhttp_realloc(void *ptr, size_t size)
+{
+    if (!ptr)
+        return easyhttp_malloc(size);
+    if (size > SIZE_MAX - sizeof(AllocationHeader_t))
+        return NULL;
+
+    //accounting may have been turned on or off since the block was allocated
+    AllocationHeader_t *header = (AllocationHeader_t *)ptr - 1;
+    size_t old_size = header->size, shrink = header->counted ? old_size : 0;
+    bool counted = flag_load(accounting);
+    if (counted && !stats_update(size, shrink, true))
+        return NULL;
+
+    AllocationHeader_t *resized = realloc(header, sizeof(AllocationHeader_t) + size);
+    if (!resized) {
+        if (counted) stats_update(shrink, size, false);
+        return NULL;
+    }
+    if (!counted && shrink > 0)
+        stats_update(0, shrink, false);
+    resized->size = size;
+    resized->counted = counted;
+    return resized + 1;
+}
+
+void easyhttp_free(void *ptr)
+{
+    if (!ptr) return;
+
+    AllocationHeader_t *header = (AllocationHeader_t *)ptr - 1;
+    if (header->counted)
+        stats_update(0, header->size, false);
+    free(header);
+}
+
+char *easyhttp_strdup(const char *str)
+{
+    size_t length = strlen(str);
+    char *dup = easyhttp_malloc(length + 1);
+    if (dup)
+        memcpy(dup, str, length + 1);
+    return dup;
+}
+
+static enum {
+    CURL_ALLOCATOR_NONE, //libcurl isn't initialised yet
+    CURL_ALLOCATOR_SYSTEM,
+    CURL_ALLOCATOR_COUNTED,
+} curl_allocator = CURL_ALLOCATOR_NONE;
+static mtx_t curl_mutex;
+static bool curl_mutex_ok = false;
+static once_flag curl_once = ONCE_FLAG_INIT;
+
+static void curl_mutex_init(void)
+{ curl_mutex_ok = mtx_init(&curl_mutex, mtx_plain) == thrd_success; }
+
+const char *easyhttp_memory_curl_init(bool counted)
+{
+    call_once(&curl_once, curl_mutex_init);
+    if (!curl_mutex_ok)
+        return "failed to create libcurl mutex";
+
+    const char *err = NULL;
+    mtx_lock(&curl_mutex);
+    if (curl_allocator == CURL_ALLOCATOR_NONE) {
+        CURLcode res = counted ? curl_global_init_mem(CURL_GLOBAL_ALL, easyhttp_malloc, easyhttp_free, easyhttp_realloc,
+                                                      easyhttp_strdup, easyhttp_calloc)
+                               : curl_global_init(CURL_GLOBAL_ALL);
+        if (res == CURLE_OK)
+            curl_allocator = counted ? CURL_ALLOCATOR_COUNTED : CURL_ALLOCATOR_SYSTEM;
+        else
+            err = "failed to initialize libcurl";
+    } else if (counted && curl_allocator != CURL_ALLOCATOR_COUNTED) {
+        err = "count_libcurl must be configured before the first request";
+    }
+    mtx_unlock(&curl_mutex);
+    return err;
+}
+
+void easyhttp_memory_curl_check(lua_State *L)
+{
+    const char *err = easyhttp_memory_curl_init(false);
+    if (err)
+        luaL_error(L, "%s", err);
+}
+
+void easyhttp_memory_curl_cleanup(void)
+{
+    call_once(&curl_once, curl_mutex_init);
+    if (!curl_mutex_ok)
+        return;
+
+    mtx_lock(&curl_mutex);
+    if (curl_allocator != CURL_ALLOCATOR_NONE) {
+        curl_global_cleanup();
+        curl_allocator = CURL_ALLOCATOR_NONE;
+    }
+    mtx_unlock(&curl_mutex);
+}
+
+void easyhttp_memory_set_limit(size_t max)
+{
+    counter_store(limit, max);
+    accounting_update();
+}
+
+void easyhttp_memory_set_stats(bool enabled)
+{
+    flag_store(stats_enabled, enabled);
+    accounting_update();
+}
+
+void easyhttp_memory_count_request(void)
+{
+    if (flag_load(accounting))
+        counter_add(requests, 1);
+}
+
+void easyhttp_memory_track_buffered(size_t grow, size_t shrink)
+{
+    if (grow > 0) counter_add(buffered, grow);
+    if (shrink > 0) counter_sub(buffered, shrink);
+}
+
+struct easyhttp_MemoryStats easyhttp_memory_stats(bool reset)
+{
+    struct easyhttp_MemoryStats copy = {
+        .current = counter_load(current),
+        .peak = counter_load(peak),
+        .allocations = counter_load(allocations),
+        .allocated = counter_load(allocated),
+        .failed = counter_load(failed),
+        .requests = counter_load(requests),
+        .limit = counter_load(limit),
+        .accounting = flag_load(accounting),
+    };
+    //the counters are read one by one, so allocations made meanwhile may show up in some of them but not others
+    if (copy.peak < copy.current)
+        copy.peak = copy.current;
+
+    if (reset) {
+        counter_store(peak, copy.current);
+        counter_store(allocations, 0);
+        counter_store(allocated, 0);
+        counter_store(failed, 0);
+        counter_store(requests, 0);
+    }
+    return copy;
+}
+
+void easyhttp_memory_pace_gc(lua_State *L)
+{
+    size_t now = counter_load(buffered), paced = counter_load(gc_paced), grown = 0;
+    if (now < paced) {
+        counter_replace(gc_paced, &paced, now);
+    } else if (now - paced >= EASYHTTP_GC_PACE_THRESHOLD && counter_replace(gc_paced, &paced, now)) {
+        //only one state steps for the growth, if several pace at once
+        grown = now - paced;
+    }
+
+    //the step size is in KiB, as if that much had been allocated by Lua
+    if (grown > 0) {
+        size_t kib = grown / 1024;
+        lua_gc(L, LUA_GCSTEP, kib > INT_MAX ? INT_MAX : (int)kib);
+    }
+}
+
+int easyhttp_memory_stats_lua(lua_State *L)
+{
+    struct easyhttp_MemoryStats copy = easyhttp_memory_stats(lua_toboolean(L, 1));
+
+    lua_createtable(L, 0, 10);
+    lua_pushinteger(L, (lua_Integer)copy.current);
+    lua_setfield(L, -2, "current");
+    lua_pushinteger(L, (lua_Integer)copy.peak);
+    lua_setfield(L, -2, "peak");
+    lua_pushinteger(L, (lua_Integer)copy.allocations);
+    lua_setfield(L, -2, "allocations");
+    lua_pushinteger(L, (lua_Integer)copy.allocated);
+    lua_setfield(L, -2, "allocated");
+    lua_pushinteger(L, (lua_Integer)copy.failed);
+    lua_setfield(L, -2, "failed");
+    lua_pushinteger(L, (lua_Integer)copy.requests);
+    lua_setfield(L, -2, "requests");
+    lua_pushnumber(L, copy.requests ? (lua_Number)copy.allocations / (lua_Number)copy.requests : 0);
+    lua_setfield(L, -2, "allocations_per_request");
+    lua_pushnumber(L, copy.requests ? (lua_Number)copy.allocated / (lua_Number)copy.requests : 0);
+    lua_setfield(L, -2, "bytes_per_request");
+    lua_pushinteger(L, (lua_Integer)copy.limit);
+    lua_setfield(L, -2, "limit");
+    lua_pushboolean(L, copy.accounting);
+    lua_setfield(L, -2, "accounting");
+    return 1;
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2024 Amrit Bhogal
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef EASYHTTP_MEMORY_H
+#define EASYHTTP_MEMORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "extern/compat-5.3.h"
+
+//Counted allocator used by easyhttp, and by libcurl if `configure { count_libcurl = true }` came before the first request.
+//The Lua allocator is not used, as libcurl and the event loop allocate from other threads.
+void *easyhttp_malloc(size_t size);
+void *easyhttp_calloc(size_t count, size_t size);
+void *easyhttp_realloc(void *ptr, size_t size);
+void easyhttp_free(void *ptr);
+char *easyhttp_strdup(const char *str);
+
+//Nothing is counted unless accounting is on, which it is with `memory_stats` or a `memory_limit`
+struct easyhttp_MemoryStats {
+    size_t current, peak; //bytes
+    size_t allocations, allocated; //allocated is the bytes of all allocations, freed or not
+    size_t failed; //allocations refused because of the limit
+    size_t requests;
+    size_t limit; //0 is unlimited
+    bool accounting;
+};
+
+//Initialises libcurl if it isn't yet, with the system allocator or the counted one. Once initialised the allocator
+//can't change, so asking for the counted one after that fails. If libcurl was initialised by someone else it keeps its own
+const char *easyhttp_memory_curl_init(bool counted);
+//easyhttp_memory_curl_init(false), raising on failure. Called by everything which creates curl handles
+void easyhttp_memory_curl_check(lua_State *L);
+//Cleans up libcurl, once the last state is closed and no handle is left
+void easyhttp_memory_curl_cleanup(void);
+//Allocations which would take the current usage over `limit` fail, 0 removes the limit
+void easyhttp_memory_set_limit(size_t limit);
+//Turns the peak, allocation and request counters on or off, they cost an atomic update or two per allocation
+void easyhttp_memory_set_stats(bool enabled);
+//Counts a request, for the per request figures
+void easyhttp_memory_count_request(void);
+//Tracks the response body segments in use, which the collector is paced on
+void easyhttp_memory_track_buffered(size_t grow, size_t shrink);
+//Reads the counters, `reset` then resets the peak to the current usage and the other counters to 0
+struct easyhttp_MemoryStats easyhttp_memory_stats(bool reset);
+
+//Native memory which the collector has to be told about before it steps, keeps small requests from forcing steps
+#define EASYHTTP_GC_PACE_THRESHOLD ((size_t)1024 * 1024)
+
+//Userdata holding native memory look tiny to Lua's collector, so it is stepped in proportion to how much the buffered
+//response bodies grew since the last call. Called wherever new native memory is handed to Lua.
+void easyhttp_memory_pace_gc(lua_State *L);
+
+/*
+function easyhttp.memory_stats(reset: boolean?): {
+    current: integer,
+    peak: integer,
+    allocations: integer,
+    allocated: integer,
+    failed: integer,
+    requests: integer,
+    allocations_per_request: number,
+    bytes_per_request: number,
+    limit: integer,
+    accounting: boolean,
+}
+*/
+int easyhttp_memory_stats_lua(lua_State *L);
+
+#endif //EASYHTTP_MEMORY_H
@@ -0,0 +1,258 @@
+/**
+ * Copyright (c) 2024 Amrit Bhogal
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include "multi.h"
+#include "config.h"
+#include "pool.h"
+#include "share.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <curl/curl.h>
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static struct easyhttp_MultiRequestOptions request_options_parse(lua_State *L, int idx, const char **error)
+{
+    struct easyhttp_MultiRequestOptions options = {
+        .base = easyhttp_options_parse(L, idx, error),
+        .on_finish = LUA_NOREF,
+        .on_error = LUA_NOREF
+    };
+    if (*error) return options;
+
+    //reported instead of raised, so the base options can be released
+    lua_getfield(L, idx, "on_finish");
+    lua_getfield(L, idx, "on_error");
+    if (!lua_isnil(L, -2) && !lua_isfunction(L, -2))
+        *error = "on_finish must be a function";
+    else if (!lua_isnil(L, -1) && !lua_isfunction(L, -1))
+        *error = "on_error must be a function";
+    lua_pop(L, 2);
+    if (*error) return options;
+
+    options_getfield(on_finish, easyhttp_lua_checkfunction);
+    options_getfield(on_error, easyhttp_lua_checkfunction);
+
+    return options;
+}
+
+static void transfer_release(struct easyhttp_MultiRequest *multi, struct easyhttp_MultiTransfer *t)
+{
+    if (t->transfer.handle) {
+        curl_multi_remove_handle(multi->multi_handle, t->transfer.handle);
+        easyhttp_pool_handle_release(t->transfer.handle);
+        t->transfer.handle = NULL;
+    }
+    easyhttp_transfer_cleanup(&t->transfer);
+}
+
+static void transfer_finish(lua_State *L, struct easyhttp_MultiRequest *multi, struct easyhttp_MultiTransfer *t, CURLcode result)
+{
+    t->done = true;
+    multi->completed++;
+
+    //release before calling back, so an error in the callback can't leave the transfer half done
+    if (result == CURLE_OK) {
+        if (t->on_finish != LUA_NOREF) {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, t->on_finish);
+            easyhttp_transfer_push_response(&t->transfer);
+            transfer_release(multi, t);
+            lua_call(L, 3, 0);
+            return;
+        }
+    } else if (t->on_error != LUA_NOREF) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, t->on_error);
+        lua_pushfstring(L, "failed to perform request: %s", easyhttp_transfer_strerror(&t->transfer, result));
+        transfer_release(multi, t);
+        lua_call(L, 1, 0);
+        return;
+    }
+
+    transfer_release(multi, t);
+}
+
+int easyhttp_multi_request(lua_State *L)
+{
+    easyhttp_memory_curl_check(L);
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_settop(L, 1);
+
+    size_t count = 0;
+    lua_pushnil(L);
+    while (lua_next(L, 1)) {
+        if (lua_type(L, -2) != LUA_TSTRING)
+            return luaL_error(L, "multi_request keys must be urls");
+        luaL_checktype(L, -1, LUA_TTABLE);
+        count++;
+        lua_pop(L, 1);
+    }
+
+    struct easyhttp_MultiRequest *multi = lua_newuserdata(L, sizeof(struct easyhttp_MultiRequest) + count * sizeof(struct easyhttp_MultiTransfer));
+    *multi = (struct easyhttp_MultiRequest) { .requests = LUA_NOREF };
+    luaL_setmetatable(L, EASYHTTP_MULTI_REQUEST_TNAME);
+
+    lua_pushvalue(L, 1);
+    multi->requests = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    multi->multi_handle = curl_multi_init();
+    if (!multi->multi_handle) {
+        lua_pushnil(L);
+        lua_pushliteral(L, "failed to create multi handle");
+        return 2;
+    }
+    struct easyhttp_Config config = easyhttp_config_get();
+    easyhttp_config_apply(&config, multi->multi_handle);
+
+    lua_pushnil(L);
+    while (lua_next(L, 1)) {
+        const char *url = lua_tostring(L, -2);
+
+        const char *err = NULL;
+        struct easyhttp_MultiRequestOptions options = request_options_parse(L, lua_gettop(L), &err);
+        if (err) {
+            //not part of `multi` yet, so __gc won't release these
+            easyhttp_options_free(L, &options.base);
+            luaL_unref(L, LUA_REGISTRYINDEX, options.on_finish);
+            luaL_unref(L, LUA_REGISTRYINDEX, options.on_error);
+            lua_pushnil(L);
+            lua_pushstring(L, err);
+            return 2;
+        }
+
+        struct easyhttp_MultiTransfer *t = &multi->transfers[multi->count++];
+        *t = (struct easyhttp_MultiTransfer) {
+            .transfer.options = options.base,
+            .on_finish = options.on_finish,
+            .on_error = options.on_error,
+        };
+
+        CURL *handle = easyhttp_pool_handle_acquire();
+        if (!handle) {
+            lua_pushnil(L);
+            lua_pushliteral(L, "failed to create curl handle");
+            return 2;
+        }
+        easyhttp_share_attach(easyhttp_share_state(L), handle);
+
+        err = easyhttp_transfer_setup(&t->transfer, L, handle, url);
+        if (err) {
+            lua_pushnil(L);
+            lua_pushstring(L, err);
+            return 2;
+        }
+        curl_easy_setopt(handle, CURLOPT_PRIVATE, t);
+
+        if (curl_multi_add_handle(multi->multi_handle, handle) != CURLM_OK) {
+            lua_pushnil(L);
+            lua_pushliteral(L, "failed to add request to multi handle");
+            return 2;
+        }
+
+        lua_pop(L, 1);
+    }
+
+    return 1;
+}
+
+int easyhttp_multi_request_perform(lua_State *L)
+{
+    struct easyhttp_MultiRequest *multi = luaL_checkudata(L, 1, EASYHTTP_MULTI_REQUEST_TNAME);
+    lua_Number timeout = luaL_optnumber(L, 2, -1);
+    double deadline = timeout >= 0 ? now_seconds() + timeout : 0;
+
+    //callbacks (and body readers) run on whichever thread (or coroutine) is driving the transfers
+    for (size_t i = 0; i < multi->count; i++)
+        multi->transfers[i].transfer.L = multi->transfers[i].transfer.upload.L = L;
+
+    int running = 0;
+    for (;;) {
+        CURLMcode mc = curl_multi_perform(multi->multi_handle, &running);
+        if (mc != CURLM_OK) {
+            lua_pushnil(L);
+            lua_pushfstring(L, "failed to perform requests: %s", curl_multi_strerror(mc));
+            return 2;
+        }
+
+        CURLMsg *msg = NULL;
+        int queued = 0;
+        while ((msg = curl_multi_info_read(multi->multi_handle, &queued))) {
+            if (msg->msg != CURLMSG_DONE) continue;
+
+            struct easyhttp_MultiTransfer *t = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&t);
+            transfer_finish(L, multi, t, msg->data.result);
+        }
+
+        if (running == 0)
+            break;
+
+        int wait_ms = 1000;
+        if (timeout >= 0) {
+            double remaining = deadline - now_seconds();
+            if (remaining <= 0)
+                break;
+            if (remaining * 1000 < wait_ms)
+                wait_ms = (int)(remaining * 1000) + 1;
+        }
+
+        mc = curl_multi_poll(multi->multi_handle, NULL, 0, wait_ms, NULL);
+        if (mc != CURLM_OK) {
+            lua_pushnil(L);
+            lua_pushfstring(L, "failed to poll requests: %s", curl_multi_strerror(mc));
+            return 2;
+        }
+    }
+
+    lua_pushinteger(L, running);
+    return 1;
+}
+
+int easyhttp_multi_request_completed_requests(lua_State *L)
+{
+    struct easyhttp_MultiRequest *multi = luaL_checkudata(L, 1, EASYHTTP_MULTI_REQUEST_TNAME);
+    lua_pushinteger(L, multi->completed);
+    return 1;
+}
+
+int easyhttp_multi_request__len(lua_State *L)
+{
+    struct easyhttp_MultiRequest *multi = luaL_checkudata(L, 1, EASYHTTP_MULTI_REQUEST_TNAME);
+    lua_pushinteger(L, multi->count);
+    return 1;
+}
+
+int easyhttp_multi_request__gc(lua_State *L)
+{
+    struct easyhttp_MultiRequest *multi = luaL_checkudata(L, 1, EASYHTTP_MULTI_REQUEST_TNAME);
+
+    for (size_t i = 0; i < multi->count; i++) {
+        struct easyhttp_MultiTransfer *t = &multi->transfers[i];
+        //the state which last drove the transfers may be a coroutine which is gone by now
+        t->transfer.L = t->transfer.upload.L = L;
+        transfer_release(multi, t);
+        luaL_unref(L, LUA_REGISTRYINDEX, t->on_finish);
+        luaL_unref(L, LUA_REGISTRYINDEX, t->on_error);
+    }
+    multi->count = 0;
+
+    if (multi->multi_handle) {
+        curl_multi_cleanup(multi->multi_handle);
+        multi->multi_handle = NULL;
+    }
+
+    luaL_unref(L, LUA_REGISTRYINDEX, multi->requests);
+    multi->requests = LUA_NOREF;
+    return 0;
+}
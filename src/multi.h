@@ -7,6 +7,7 @@
 #define EASYHTTP_MULTI_H
 
 #include "common.h"
+#include "transfer.h"
 
 struct easyhttp_MultiRequestOptions {
     struct easyhttp_Options base;
@@ -15,36 +16,30 @@ struct easyhttp_MultiRequestOptions {
     LuaReference_t on_error; //function(error: string)
 };
 
+struct easyhttp_MultiTransfer {
+    struct easyhttp_Transfer transfer;
+    LuaReference_t on_finish, on_error;
+    bool done;
+};
+
 #define EASYHTTP_MULTI_REQUEST_TNAME "easyhttp.MultiRequest"
 struct easyhttp_MultiRequest {
     CURLM *multi_handle;
+    LuaReference_t requests; //keeps the urls and the values borrowed by the options alive
 
-    size_t count;
-    CURL *(*handles)[];
-    struct easyhttp_MultiRequestOptions (*options)[];
-    const char *(*urls)[];
+    size_t count, completed;
+    struct easyhttp_MultiTransfer transfers[];
 };
 
-static struct easyhttp_MultiRequestOptions easyhttp_multi_request_options_parse(lua_State *L, int idx, const char **error)
-{
-    struct easyhttp_MultiRequestOptions options = {
-        .base = easyhttp_options_parse(L, idx, error),
-        .on_finish = LUA_NOREF,
-        .on_error = LUA_NOREF
-    };
-    if (*error) return options;
-
-    options_getfield(on_finish, easyhttp_lua_checkfunction);
-    options_getfield(on_error, easyhttp_lua_checkfunction);
-
-    return options;
-}
-
 /*
 function easyhttp.multi_request(options: { [string] : easyhttp.MultiRequestOptions }): easyhttp.MultiRequest
 */
 int easyhttp_multi_request(lua_State *L);
 /*
+function easyhttp.MultiRequest:perform(timeout: number?): integer
+*/
+int easyhttp_multi_request_perform(lua_State *L);
+/*
 function easyhttp.MultiRequest:completed_requests(): integer
 */
 int easyhttp_multi_request_completed_requests(lua_State *L);
@@ -54,4 +49,4 @@ function easyhttp.MultiRequest:__len(): integer
 int easyhttp_multi_request__len(lua_State *L);
 int easyhttp_multi_request__gc(lua_State *L);
 
-#endif
+#endif //EASYHTTP_MULTI_H
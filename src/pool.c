@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) 2024 Amrit Bhogal
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include "pool.h"
+
+#include <stdlib.h>
+
+#include <curl/curl.h>
+
+#define EASYHTTP_POOL_MAX_OBJECTS 64
+
+static struct {
+    mtx_t lock;
+    size_t count, limit;
+    void *objects[EASYHTTP_POOL_MAX_OBJECTS];
+} pools[EASYHTTP_POOL_KIND_COUNT];
+
+static bool pools_ok = false;
+static once_flag pools_once = ONCE_FLAG_INIT;
+
+static void pools_init(void)
+{
+    static const size_t limits[EASYHTTP_POOL_KIND_COUNT] = {
+        [EASYHTTP_POOL_BUFFERS] = 64,
+        [EASYHTTP_POOL_SEGMENTS] = 64, //1 MiB
+        [EASYHTTP_POOL_HEADERS] = 32,
+        //idle handles keep their connections open, so don't hold on to too many
+        [EASYHTTP_POOL_HANDLES] = 16,
+    };
+
+    for (size_t i = 0; i < EASYHTTP_POOL_KIND_COUNT; i++) {
+        if (mtx_init(&pools[i].lock, mtx_plain) != thrd_success) {
+            while (i-- > 0)
+                mtx_destroy(&pools[i].lock);
+            return;
+        }
+        pools[i].limit = limits[i];
+    }
+    pools_ok = true;
+}
+
+void *easyhttp_pool_take(enum easyhttp_PoolKind kind)
+{
+    call_once(&pools_once, pools_init);
+    if (!pools_ok)
+        return NULL;
+
+    void *object = NULL;
+    mtx_lock(&pools[kind].lock);
+    if (pools[kind].count > 0)
+        object = pools[kind].objects[--pools[kind].count];
+    mtx_unlock(&pools[kind].lock);
+    return object;
+}
+
+bool easyhttp_pool_give(enum easyhttp_PoolKind kind, void *object)
+{
+    call_once(&pools_once, pools_init);
+    if (!pools_ok)
+        return false;
+
+    bool kept = false;
+    mtx_lock(&pools[kind].lock);
+    if (pools[kind].count < pools[kind].limit) {
+        pools[kind].objects[pools[kind].count++] = object;
+        kept = true;
+    }
+    mtx_unlock(&pools[kind].lock);
+    return kept;
+}
+
+CURL *easyhttp_pool_handle_acquire(void)
+{
+    CURL *handle = easyhttp_pool_take(EASYHTTP_POOL_HANDLES);
+    return handle ? handle : curl_easy_init();
+}
+
+void easyhttp_pool_handle_drain(void)
+{
+    CURL *handle = NULL;
+    while ((handle = easyhttp_pool_take(EASYHTTP_POOL_HANDLES)))
+        curl_easy_cleanup(handle);
+}
+
+void easyhttp_pool_handle_release(CURL *handle)
+{
+    if (!handle) return;
+
+    //keeps the handle's connections, DNS cache and TLS sessions, and drops everything else.
+    //The share is dropped too, it may belong to a state which is closed before the handle is used again
+    curl_easy_setopt(handle, CURLOPT_SHARE, NULL);
+    curl_easy_reset(handle);
+    if (!easyhttp_pool_give(EASYHTTP_POOL_HANDLES, handle))
+        curl_easy_cleanup(handle);
+}
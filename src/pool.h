@@ -0,0 +1,33 @@
+// Copyright (c) 2024 Amrit Bhogal
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef EASYHTTP_POOL_H
+#define EASYHTTP_POOL_H
+
+#include "common.h"
+
+//Process-wide freelists, so a steady stream of requests stops allocating once warmed up.
+//Each one only holds objects of a single size, and is bounded so bursts don't stay allocated forever.
+enum easyhttp_PoolKind {
+    EASYHTTP_POOL_BUFFERS,  //struct easyhttp_Buffer
+    EASYHTTP_POOL_SEGMENTS, //buffer segments of EASYHTTP_BUFFER_SEGMENT_SIZE
+    EASYHTTP_POOL_HEADERS,  //struct easyhttp_Headers
+    EASYHTTP_POOL_HANDLES,  //reset curl easy handles
+    EASYHTTP_POOL_KIND_COUNT
+};
+
+//Takes an object out of the pool, NULL if it is empty
+void *easyhttp_pool_take(enum easyhttp_PoolKind kind);
+//Puts an object back into the pool, returns false if it is full and the caller has to free it
+bool easyhttp_pool_give(enum easyhttp_PoolKind kind, void *object);
+
+//A reset easy handle, from the pool or newly created. The caller attaches a share if it wants one
+CURL *easyhttp_pool_handle_acquire(void);
+//Resets the handle and keeps it for later, the handle must not be in a multi handle
+void easyhttp_pool_handle_release(CURL *handle);
+//Cleans up the pooled handles, before libcurl itself is cleaned up
+void easyhttp_pool_handle_drain(void);
+
+#endif //EASYHTTP_POOL_H
@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2024 Amrit Bhogal
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include "preconnect.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <curl/curl.h>
+
+#define EASYHTTP_PRECONNECT_DEFAULT_TIMEOUT 10
+
+int easyhttp_preconnect_share(lua_State *L, int idx, struct easyhttp_Share *share, const struct easyhttp_Options *options, long timeout)
+{
+    luaL_checktype(L, idx, LUA_TTABLE);
+    size_t count = lua_rawlen(L, idx);
+    for (size_t i = 1; i <= count; i++) {
+        lua_rawgeti(L, idx, i);
+        luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, idx, "urls must be strings");
+        lua_pop(L, 1);
+    }
+
+    CURLM *multi = curl_multi_init();
+    CURL **handles = easyhttp_calloc(count ? count : 1, sizeof(CURL *));
+    if (!multi || !handles) {
+        if (multi) curl_multi_cleanup(multi);
+        easyhttp_free(handles);
+        lua_pushnil(L);
+        lua_pushliteral(L, "failed to allocate memory for preconnect");
+        return 2;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        CURL *handle = handles[i] = curl_easy_init();
+        if (!handle) continue;
+        easyhttp_share_attach(share, handle);
+
+        //a bodyless request leaves a connection curl can hand to later transfers, CONNECT_ONLY ones never are.
+        //Only the connection and header options apply, a default body must not turn it into a POST
+        struct easyhttp_Options head = options ? *options : EASYHTTP_DEFAULT_OPTIONS;
+        head.body = NULL;
+        easyhttp_options_set(head, handle);
+        curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, NULL);
+        curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
+        curl_easy_setopt(handle, CURLOPT_NOBODY, 1L);
+
+        lua_rawgeti(L, idx, i + 1);
+        curl_easy_setopt(handle, CURLOPT_URL, lua_tostring(L, -1));
+        lua_pop(L, 1);
+
+        curl_easy_setopt(handle, CURLOPT_TIMEOUT, timeout);
+        curl_multi_add_handle(multi, handle);
+    }
+
+    lua_Integer connected = 0;
+    int running = 0;
+    do {
+        if (curl_multi_perform(multi, &running) != CURLM_OK)
+            break;
+
+        CURLMsg *msg = NULL;
+        int queued = 0;
+        while ((msg = curl_multi_info_read(multi, &queued))) {
+            if (msg->msg == CURLMSG_DONE && msg->data.result == CURLE_OK)
+                connected++;
+        }
+
+        if (running && curl_multi_poll(multi, NULL, 0, 1000, NULL) != CURLM_OK)
+            break;
+    } while (running);
+
+    for (size_t i = 0; i < count; i++) {
+        if (!handles[i]) continue;
+        curl_multi_remove_handle(multi, handles[i]);
+        curl_easy_cleanup(handles[i]);
+    }
+    curl_multi_cleanup(multi);
+    easyhttp_free(handles);
+
+    lua_pushinteger(L, connected);
+    return 1;
+}
+
+int easyhttp_preconnect(lua_State *L)
+{
+    easyhttp_memory_curl_check(L);
+    long timeout = (long)luaL_optinteger(L, 2, EASYHTTP_PRECONNECT_DEFAULT_TIMEOUT);
+    return easyhttp_preconnect_share(L, 1, easyhttp_share_state(L), NULL, timeout);
+}
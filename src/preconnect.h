@@ -0,0 +1,22 @@
+// Copyright (c) 2024 Amrit Bhogal
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef EASYHTTP_PRECONNECT_H
+#define EASYHTTP_PRECONNECT_H
+
+#include "common.h"
+#include "share.h"
+
+//Connects to every url in the array at `idx` in parallel with a `HEAD` request, and pushes the number which succeeded.
+//The connections are kept in `share`, which has to own a connection cache, `options` (if given) supplies the headers
+//and connection options.
+int easyhttp_preconnect_share(lua_State *L, int idx, struct easyhttp_Share *share, const struct easyhttp_Options *options, long timeout);
+
+/*
+function easyhttp.preconnect(urls: { string }, timeout: number?): integer
+*/
+int easyhttp_preconnect(lua_State *L);
+
+#endif //EASYHTTP_PRECONNECT_H
@@ -0,0 +1,136 @@
+/**
+ * Copyright (c) 2024 Amrit Bhogal
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include "session.h"
+#include "preconnect.h"
+#include "transfer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <curl/curl.h>
+
+static CURL *session_acquire(struct easyhttp_Session *session)
+{
+    //most recently used first, it is the one most likely to still have a live connection
+    if (session->idle_count > 0)
+        return session->idle_handles[--session->idle_count];
+
+    CURL *handle = curl_easy_init();
+    if (handle)
+        easyhttp_share_attach(&session->share, handle);
+    return handle;
+}
+
+static void session_release(struct easyhttp_Session *session, CURL *handle)
+{
+    if (session->idle_count >= EASYHTTP_SESSION_MAX_IDLE_HANDLES) {
+        curl_easy_cleanup(handle);
+        return;
+    }
+
+    curl_easy_reset(handle); //keeps the share
+    session->idle_handles[session->idle_count++] = handle;
+}
+
+int easyhttp_session(lua_State *L)
+{
+    easyhttp_memory_curl_check(L);
+    if (lua_isnoneornil(L, 1)) {
+        lua_settop(L, 0);
+        lua_newtable(L);
+    } else {
+        luaL_checktype(L, 1, LUA_TTABLE);
+        lua_settop(L, 1);
+    }
+
+    const char *err = NULL;
+    struct easyhttp_Options defaults = easyhttp_options_parse(L, 1, &err);
+    if (err) {
+        easyhttp_options_free(L, &defaults);
+        lua_pushnil(L);
+        lua_pushstring(L, err);
+        return 2;
+    }
+
+    struct easyhttp_Session *session = lua_newuserdata(L, sizeof(struct easyhttp_Session));
+    *session = (struct easyhttp_Session) {
+        .defaults = defaults,
+        .defaults_table = LUA_NOREF,
+    };
+    luaL_setmetatable(L, EASYHTTP_SESSION_TNAME);
+
+    err = easyhttp_share_init(&session->share, true);
+    if (err) {
+        lua_pushnil(L);
+        lua_pushstring(L, err);
+        return 2;
+    }
+
+    lua_pushvalue(L, 1);
+    session->defaults_table = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    return 1;
+}
+
+int easyhttp_session_request(lua_State *L)
+{
+    struct easyhttp_Session *session = luaL_checkudata(L, 1, EASYHTTP_SESSION_TNAME);
+    const char *url = luaL_checkstring(L, 2);
+
+    if (lua_isnoneornil(L, 3)) {
+        lua_settop(L, 2);
+        lua_newtable(L);
+    } else {
+        luaL_checktype(L, 3, LUA_TTABLE);
+    }
+
+    const char *err = NULL;
+    struct easyhttp_Options opts = easyhttp_options_parse_from(L, 3, &session->defaults, &err);
+    if (err) {
+        easyhttp_options_free(L, &opts);
+        lua_pushnil(L);
+        lua_pushstring(L, err);
+        return 2;
+    }
+
+    CURL *handle = session_acquire(session);
+    if (!handle) {
+        easyhttp_options_free(L, &opts);
+        lua_pushnil(L);
+        lua_pushliteral(L, "failed to create curl handle");
+        return 2;
+    }
+
+    int nret = easyhttp_transfer_perform(L, handle, url, opts);
+    session_release(session, handle);
+    return nret;
+}
+
+int easyhttp_session_warm(lua_State *L)
+{
+    struct easyhttp_Session *session = luaL_checkudata(L, 1, EASYHTTP_SESSION_TNAME);
+    long timeout = (long)luaL_optinteger(L, 3, session->defaults.timeout > 0 ? session->defaults.timeout : 10);
+    //with the session defaults, so the connections match the ones requests will look for (e.g. the http version)
+    return easyhttp_preconnect_share(L, 2, &session->share, &session->defaults, timeout);
+}
+
+int easyhttp_session__gc(lua_State *L)
+{
+    struct easyhttp_Session *session = luaL_checkudata(L, 1, EASYHTTP_SESSION_TNAME);
+
+    for (size_t i = 0; i < session->idle_count; i++)
+        curl_easy_cleanup(session->idle_handles[i]);
+    session->idle_count = 0;
+    easyhttp_share_destroy(&session->share);
+
+    easyhttp_options_free(L, &session->defaults);
+    luaL_unref(L, LUA_REGISTRYINDEX, session->defaults_table);
+    session->defaults_table = LUA_NOREF;
+
+    return 0;
+}
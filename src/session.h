@@ -0,0 +1,41 @@
+// Copyright (c) 2024 Amrit Bhogal
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef EASYHTTP_SESSION_H
+#define EASYHTTP_SESSION_H
+
+#include "common.h"
+#include "share.h"
+
+//Idle handles kept around by a session, more than this are cleaned up once released
+#define EASYHTTP_SESSION_MAX_IDLE_HANDLES 8
+
+#define EASYHTTP_SESSION_TNAME "easyhttp.Session"
+struct easyhttp_Session {
+    struct easyhttp_Options defaults;
+    LuaReference_t defaults_table; //keeps the values borrowed by `defaults` alive
+
+    //live connections, DNS answers and TLS sessions, shared by all of the session's handles
+    struct easyhttp_Share share;
+
+    size_t idle_count;
+    CURL *idle_handles[EASYHTTP_SESSION_MAX_IDLE_HANDLES];
+};
+
+/*
+function easyhttp.session(defaults: easyhttp.RequestOptions?): easyhttp.Session | (nil, string error)
+*/
+int easyhttp_session(lua_State *L);
+/*
+function easyhttp.Session:request(url: string, options: easyhttp.RequestOptions?): same as easyhttp.request
+*/
+int easyhttp_session_request(lua_State *L);
+/*
+function easyhttp.Session:warm(urls: { string }, timeout: integer?): integer
+*/
+int easyhttp_session_warm(lua_State *L);
+int easyhttp_session__gc(lua_State *L);
+
+#endif //EASYHTTP_SESSION_H
@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2024 Amrit Bhogal
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include "share.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <curl/curl.h>
+
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userp)
+{
+    (void)handle; (void)access;
+    struct easyhttp_Share *share = userp;
+    mtx_lock(&share->locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userp)
+{
+    (void)handle;
+    struct easyhttp_Share *share = userp;
+    mtx_unlock(&share->locks[data]);
+}
+
+const char *easyhttp_share_init(struct easyhttp_Share *share, bool connections)
+{
+    *share = (struct easyhttp_Share) {0};
+
+    for (size_t i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        if (mtx_init(&share->locks[i], mtx_plain) != thrd_success) {
+            while (i-- > 0)
+                mtx_destroy(&share->locks[i]);
+            return "failed to create share mutex";
+        }
+    }
+
+    share->handle = curl_share_init();
+    if (!share->handle) {
+        for (size_t i = 0; i < CURL_LOCK_DATA_LAST; i++)
+            mtx_destroy(&share->locks[i]);
+        return "failed to create share handle";
+    }
+
+    curl_share_setopt(share->handle, CURLSHOPT_LOCKFUNC, share_lock);
+    curl_share_setopt(share->handle, CURLSHOPT_UNLOCKFUNC, share_unlock);
+    curl_share_setopt(share->handle, CURLSHOPT_USERDATA, share);
+
+    curl_share_setopt(share->handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share->handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+    //older versions reject it, in which case each handle keeps its own connections
+    if (connections)
+        curl_share_setopt(share->handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#else
+    (void)connections;
+#endif
+
+    return NULL;
+}
+
+void easyhttp_share_destroy(struct easyhttp_Share *share)
+{
+    if (!share->handle) return;
+
+    curl_share_cleanup(share->handle);
+    share->handle = NULL;
+    for (size_t i = 0; i < CURL_LOCK_DATA_LAST; i++)
+        mtx_destroy(&share->locks[i]);
+}
+
+static struct easyhttp_Share global_share;
+static bool global_share_ok = false;
+static mtx_t global_share_mutex;
+static bool global_share_mutex_ok = false;
+static once_flag global_share_once = ONCE_FLAG_INIT;
+
+static void global_share_init(void)
+{ global_share_mutex_ok = mtx_init(&global_share_mutex, mtx_plain) == thrd_success; }
+
+struct easyhttp_Share *easyhttp_share_global(void)
+{
+    call_once(&global_share_once, global_share_init);
+    if (!global_share_mutex_ok)
+        return NULL;
+
+    //created on first use rather than once, as it goes away with libcurl when the last state is closed
+    mtx_lock(&global_share_mutex);
+    if (!global_share_ok)
+        global_share_ok = easyhttp_share_init(&global_share, false) == NULL;
+    mtx_unlock(&global_share_mutex);
+    return global_share_ok ? &global_share : NULL;
+}
+
+void easyhttp_share_global_destroy(void)
+{
+    call_once(&global_share_once, global_share_init);
+    if (!global_share_mutex_ok)
+        return;
+
+    mtx_lock(&global_share_mutex);
+    if (global_share_ok)
+        easyhttp_share_destroy(&global_share);
+    global_share_ok = false;
+    mtx_unlock(&global_share_mutex);
+}
+
+static int state_share__gc(lua_State *L)
+{
+    easyhttp_share_destroy(luaL_checkudata(L, 1, EASYHTTP_STATE_SHARE_TNAME));
+    return 0;
+}
+
+void easyhttp_share_state_open(lua_State *L)
+{
+    //opening the library again must not drop a share which handles may still use
+    lua_getfield(L, LUA_REGISTRYINDEX, EASYHTTP_STATE_SHARE_TNAME);
+    bool exists = !lua_isnil(L, -1);
+    lua_pop(L, 1);
+    if (exists)
+        return;
+
+    //libcurl may not be initialised yet, so the share itself is created on first use
+    struct easyhttp_Share *share = lua_newuserdata(L, sizeof(struct easyhttp_Share));
+    *share = (struct easyhttp_Share) {0};
+    luaL_newmetatable(L, EASYHTTP_STATE_SHARE_TNAME);
+    lua_pushcfunction(L, state_share__gc);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_setfield(L, LUA_REGISTRYINDEX, EASYHTTP_STATE_SHARE_TNAME);
+}
+
+struct easyhttp_Share *easyhttp_share_state(lua_State *L)
+{
+    lua_getfield(L, LUA_REGISTRYINDEX, EASYHTTP_STATE_SHARE_TNAME);
+    struct easyhttp_Share *share = luaL_testudata(L, -1, EASYHTTP_STATE_SHARE_TNAME);
+    lua_pop(L, 1);
+
+    if (share && !share->handle && easyhttp_share_init(share, true) != NULL)
+        share = NULL;
+    return share ? share : easyhttp_share_global();
+}
@@ -0,0 +1,40 @@
+// Copyright (c) 2024 Amrit Bhogal
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef EASYHTTP_SHARE_H
+#define EASYHTTP_SHARE_H
+
+#include "common.h"
+
+//DNS cache, TLS session cache and (optionally) connection cache shared between easy handles
+struct easyhttp_Share {
+    CURLSH *handle;
+    mtx_t locks[CURL_LOCK_DATA_LAST];
+};
+
+//libcurl does not support sharing connections between concurrent threads, so only share them for single threaded users
+const char *easyhttp_share_init(struct easyhttp_Share *share, bool connections);
+void easyhttp_share_destroy(struct easyhttp_Share *share);
+
+//Process-wide share used by the async requests, NULL if it could not be created
+struct easyhttp_Share *easyhttp_share_global(void);
+//Destroys the process-wide share, only once no handle uses it anymore
+void easyhttp_share_global_destroy(void);
+
+#define EASYHTTP_STATE_SHARE_TNAME "easyhttp.StateShare"
+//Creates the slot for the share of the calling state, when the library is opened. It is finalized with the state,
+//after everything created later (so after every handle which could still use it)
+void easyhttp_share_state_open(lua_State *L);
+//Share of the calling state, used by the requests which run on its thread. A state only runs on one thread at a time,
+//so it shares connections too. Created on first use, falls back to the process-wide share if it can't be
+struct easyhttp_Share *easyhttp_share_state(lua_State *L);
+
+static inline void easyhttp_share_attach(struct easyhttp_Share *share, CURL *handle)
+{
+    if (share && share->handle)
+        curl_easy_setopt(handle, CURLOPT_SHARE, share->handle);
+}
+
+#endif //EASYHTTP_SHARE_H
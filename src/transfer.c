@@ -0,0 +1,355 @@
+/**
+ * Copyright (c) 2024 Amrit Bhogal
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include "transfer.h"
+#include "bytes.h"
+#include "file.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <curl/curl.h>
+
+static int write_callback(void *data, size_t size, size_t nmemb, void *userp)
+{
+    struct easyhttp_Transfer *args = (struct easyhttp_Transfer *)userp;
+    size_t fsiz = size * nmemb;
+
+    //curl fails a 200 with CURLE_RANGE_ERROR itself, other responses (e.g. a 416 once the file is complete) aren't part of the file
+    if (args->resume_from > 0 && !args->resume_checked) {
+        args->resume_checked = true;
+        long status_code = 0;
+        curl_easy_getinfo(args->handle, CURLINFO_RESPONSE_CODE, &status_code);
+        args->discard = status_code != 206;
+    }
+    if (args->discard)
+        return fsiz;
+
+    args->received += fsiz;
+    if (args->options.max_response_size > 0 && args->received > args->options.max_response_size) {
+        args->error = "response is larger than max_response_size";
+        return 0;
+    }
+
+    char *modified_output = NULL;
+    if (args->options.on_data != LUA_NOREF) {
+        lua_rawgeti(args->L, LUA_REGISTRYINDEX, args->options.on_data);
+        lua_pushlstring(args->L, data, fsiz);
+        lua_pushinteger(args->L, size);
+        lua_pushinteger(args->L, nmemb);
+        lua_call(args->L, 3, 1);
+        switch (lua_type(args->L, -1)) {
+            case LUA_TSTRING: {
+                size_t slen = 0;
+                const char *str = lua_tolstring(args->L, -1, &slen);
+                modified_output = string_duplicate_n(str, slen);
+                data = modified_output;
+                size = 1;
+                nmemb = slen;
+                break;
+            }
+            case LUA_TBOOLEAN: {
+                if (lua_toboolean(args->L, -1) == false) {
+                    lua_pop(args->L, 1);
+                    return 0;
+                }
+                break;
+            }
+            default: break;
+        }
+        lua_pop(args->L, 1);
+    }
+
+    bool ok = true;
+    if (args->options.output_file) {
+        //a short write fails the transfer, a resumed file would otherwise be silently left with a hole
+        ok = fwrite(data, 1, size * nmemb, args->file) == size * nmemb;
+        if (!ok)
+            args->error = "failed to write to file";
+    } else {
+        ok = easyhttp_buffer_write(data, size, nmemb, args->buffer) == size * nmemb;
+    }
+
+    easyhttp_free(modified_output);
+
+    return ok ? fsiz : 0;
+}
+
+static int progress_callback(void *clientp, double dltotal, double dlnow, double ultotal, double ulnow)
+{
+    struct easyhttp_Transfer *args = (struct easyhttp_Transfer *)clientp;
+
+    int retc = 0;
+    if (args->options.on_progress != LUA_NOREF) {
+        lua_rawgeti(args->L, LUA_REGISTRYINDEX, args->options.on_progress);
+        lua_pushnumber(args->L, dltotal);
+        lua_pushnumber(args->L, dlnow);
+        lua_pushnumber(args->L, ultotal);
+        lua_pushnumber(args->L, ulnow);
+        lua_pushinteger(args->L, (lua_Integer)args->received);
+        lua_call(args->L, 5, 1);
+
+        if (lua_isinteger(args->L, -1)) {
+            retc = lua_tointeger(args->L, -1);
+        }
+        lua_pop(args->L, 1);
+    }
+
+    return retc;
+}
+
+static size_t header_callback(char *buf, size_t size, size_t nmemb, void *userp)
+{
+    struct easyhttp_Transfer *transfer = userp;
+    if (!transfer->options.output_file)
+        easyhttp_buffer_presize(transfer->buffer, buf, size * nmemb);
+    return easyhttp_headers_write(buf, size, nmemb, transfer->headers);
+}
+
+//Continues `output_file` from its end, with If-Range once the ETag is known
+static const char *resume_setup(struct easyhttp_Transfer *transfer)
+{
+    fflush(transfer->file);
+    if (easyhttp_file_seek(transfer->file, 0, SEEK_END) != 0 || (transfer->resume_from = easyhttp_file_tell(transfer->file)) < 0)
+        return "output_file can't be resumed, it isn't seekable";
+    transfer->resume_checked = transfer->discard = false;
+    curl_easy_setopt(transfer->handle, CURLOPT_RESUME_FROM_LARGE, transfer->resume_from);
+
+    //a compressed body's upload already added Content-Encoding to its copy of the headers, which If-Range is added to in turn
+    const struct easyhttp_Options *defaults = transfer->options.defaults ? transfer->options.defaults : &EASYHTTP_DEFAULT_OPTIONS;
+    struct curl_slist *headers = transfer->upload.headers ? transfer->upload.headers
+                               : transfer->options.headers ? transfer->options.headers : defaults->headers;
+    curl_slist_free_all(transfer->request_headers);
+    transfer->request_headers = NULL;
+
+    if (transfer->resume_from > 0 && transfer->etag) {
+        for (struct curl_slist *it = headers; it; it = it->next)
+            transfer->request_headers = curl_slist_append(transfer->request_headers, it->data);
+
+        size_t length = strlen("If-Range: ") + strlen(transfer->etag) + 1;
+        char *if_range = easyhttp_malloc(length);
+        if (!if_range)
+            return "failed to allocate memory for headers";
+        snprintf(if_range, length, "If-Range: %s", transfer->etag);
+        transfer->request_headers = curl_slist_append(transfer->request_headers, if_range);
+        easyhttp_free(if_range);
+        if (!transfer->request_headers)
+            return "failed to allocate memory for headers";
+        headers = transfer->request_headers;
+    }
+    curl_easy_setopt(transfer->handle, CURLOPT_HTTPHEADER, headers);
+    return NULL;
+}
+
+//Errors which may well not happen again on a new connection
+static bool is_transient(CURLcode result)
+{
+    switch (result) {
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_RECV_ERROR:
+        case CURLE_SEND_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_HTTP2:
+        case CURLE_HTTP2_STREAM:
+        case CURLE_SSL_CONNECT_ERROR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+//How long to wait before retrying after `result`, backing off from half a second up to 8 seconds.
+//Starting over isn't a failure, so it happens right away
+static long retry_delay_ms(CURLcode result, int attempt)
+{
+    if (result == CURLE_RANGE_ERROR)
+        return 0;
+    return 500L << (attempt < 4 ? attempt : 4);
+}
+
+//Sets the transfer up to continue where the attempt which failed with `result` stopped, after waiting `delay_ms`.
+//The wait blocks the calling thread, like the transfer itself
+static const char *resume_retry(struct easyhttp_Transfer *transfer, CURLcode result, long delay_ms)
+{
+    if (result == CURLE_RANGE_ERROR) {
+        //the server sent the whole file instead of the rest (no ranges, or If-Range didn't match), which replaces the partial one
+        if (!easyhttp_file_truncate(transfer->file))
+            return "failed to truncate output_file";
+        easyhttp_free(transfer->etag);
+        transfer->etag = NULL;
+    }
+
+    //the ETag of the response which was cut off, so the next attempt only continues the same file
+    const struct easyhttp_Header *etag = easyhttp_headers_find(transfer->headers, "ETag", sizeof("ETag") - 1);
+    if (!transfer->etag && etag && strncmp(etag->value, "W/", 2) != 0)
+        transfer->etag = string_duplicate(etag->value);
+
+    //the response of the last attempt is the one returned
+    easyhttp_headers_free(&transfer->headers);
+    transfer->headers = easyhttp_headers_create();
+    if (!transfer->headers)
+        return "failed to create result headers";
+    transfer->received = 0;
+
+    if (delay_ms > 0)
+        thrd_sleep(&(struct timespec) { .tv_sec = delay_ms / 1000, .tv_nsec = (delay_ms % 1000) * 1000000L }, NULL);
+
+    return resume_setup(transfer);
+}
+
+//`transfer` must not move after this call, curl keeps pointers to it
+const char *easyhttp_transfer_setup(struct easyhttp_Transfer *transfer, lua_State *L, CURL *handle, const char *url)
+{
+    easyhttp_memory_count_request();
+    transfer->handle = handle;
+    transfer->L = L;
+    transfer->file = transfer->options.output_file ? *transfer->options.output_file : NULL;
+
+    transfer->buffer = easyhttp_buffer_create();
+    if (!transfer->buffer)
+        return "failed to create buffer";
+    if (transfer->options.expected_size > 0 && !transfer->options.output_file)
+        easyhttp_buffer_reserve(transfer->buffer, transfer->options.expected_size);
+
+    transfer->headers = easyhttp_headers_create();
+    if (!transfer->headers)
+        return "failed to create result headers";
+
+    easyhttp_options_set(transfer->options, handle);
+    curl_easy_setopt(handle, CURLOPT_URL, url);
+
+    const char *err = easyhttp_upload_setup(&transfer->upload, &transfer->options, L, handle);
+    if (err)
+        return err;
+    if (transfer->options.resume && transfer->file) {
+        if (transfer->options.resume_etag && !(transfer->etag = string_duplicate(transfer->options.resume_etag)))
+            return "failed to allocate memory for headers";
+        if ((err = resume_setup(transfer)))
+            return err;
+    }
+    if (transfer->options.form != LUA_NOREF) {
+        transfer->form = easyhttp_form_build(L, transfer->options.form, handle, &err);
+        if (!transfer->form)
+            return err;
+        curl_easy_setopt(handle, CURLOPT_MIMEPOST, transfer->form);
+    }
+
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, transfer);
+
+    if (transfer->options.on_progress != LUA_NOREF) {
+        curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(handle, CURLOPT_PROGRESSFUNCTION, progress_callback);
+        curl_easy_setopt(handle, CURLOPT_PROGRESSDATA, transfer);
+    }
+
+    curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(handle, CURLOPT_HEADERDATA, transfer);
+    return NULL;
+}
+
+const char *easyhttp_transfer_strerror(struct easyhttp_Transfer *transfer, CURLcode result)
+{
+    if (transfer->error)
+        return transfer->error;
+    if (easyhttp_upload_error(&transfer->upload))
+        return easyhttp_upload_error(&transfer->upload);
+    if (result == CURLE_FILESIZE_EXCEEDED)
+        return "response is larger than max_response_size";
+    return curl_easy_strerror(result);
+}
+
+int easyhttp_transfer_push_response(struct easyhttp_Transfer *transfer)
+{
+    lua_State *L = transfer->L;
+    //the body (and headers) may be handed over as native memory
+    easyhttp_memory_pace_gc(L);
+
+    long status_code = 0;
+    curl_easy_getinfo(transfer->handle, CURLINFO_RESPONSE_CODE, &status_code);
+
+    if (transfer->options.output_file) {
+        lua_pushboolean(L, 1);
+    } else if (transfer->options.response_bytes) {
+        easyhttp_bytes_push(L, transfer->buffer, 0);
+        transfer->buffer = NULL;
+    } else {
+        easyhttp_buffer_push(L, transfer->buffer);
+    }
+    lua_pushinteger(L, status_code);
+
+    if (transfer->options.response_headers_object) {
+        easyhttp_headers_push_object(L, transfer->headers, 0);
+        transfer->headers = NULL;
+    } else {
+        easyhttp_headers_push(L, transfer->headers);
+    }
+
+    return 3;
+}
+
+void easyhttp_transfer_cleanup(struct easyhttp_Transfer *transfer)
+{
+    easyhttp_options_free(transfer->L, &transfer->options);
+    easyhttp_buffer_free(&transfer->buffer);
+    easyhttp_headers_free(&transfer->headers);
+    easyhttp_upload_cleanup(&transfer->upload);
+    curl_mime_free(transfer->form);
+    transfer->form = NULL;
+    curl_slist_free_all(transfer->request_headers);
+    transfer->request_headers = NULL;
+    easyhttp_free(transfer->etag);
+    transfer->etag = NULL;
+}
+
+int easyhttp_transfer_perform(lua_State *L, CURL *handle, const char *url, struct easyhttp_Options options)
+{
+    struct easyhttp_Transfer transfer = { .options = options };
+
+    const char *err = easyhttp_transfer_setup(&transfer, L, handle, url);
+    if (err) {
+        easyhttp_transfer_cleanup(&transfer);
+        lua_pushnil(L);
+        lua_pushstring(L, err);
+        return 2;
+    }
+
+    CURLcode res = curl_easy_perform(handle);
+    //callback errors aren't transient, they would only happen again
+    long waited_ms = 0;
+    for (int attempt = 0; res != CURLE_OK && transfer.options.resume && transfer.file && attempt < transfer.options.retries
+                          && (is_transient(res) || (res == CURLE_RANGE_ERROR && transfer.resume_from > 0))
+                          && !transfer.error && !easyhttp_upload_error(&transfer.upload); attempt++) {
+        //`timeout` also caps the time spent waiting between attempts, the last error is returned once it is used up
+        long delay_ms = retry_delay_ms(res, attempt);
+        if (transfer.options.timeout > 0 && waited_ms + delay_ms > transfer.options.timeout * 1000L)
+            break;
+        waited_ms += delay_ms;
+
+        err = resume_retry(&transfer, res, delay_ms);
+        if (err) {
+            easyhttp_transfer_cleanup(&transfer);
+            lua_pushnil(L);
+            lua_pushstring(L, err);
+            return 2;
+        }
+        res = curl_easy_perform(handle);
+    }
+
+    if (res != CURLE_OK) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "failed to perform request: %s", easyhttp_transfer_strerror(&transfer, res));
+        easyhttp_transfer_cleanup(&transfer);
+        return 2;
+    }
+
+    int nret = easyhttp_transfer_push_response(&transfer);
+    easyhttp_transfer_cleanup(&transfer);
+    return nret;
+}
@@ -0,0 +1,48 @@
+// Copyright (c) 2024 Amrit Bhogal
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef EASYHTTP_TRANSFER_H
+#define EASYHTTP_TRANSFER_H
+
+#include "common.h"
+#include "buffer.h"
+#include "headers.h"
+#include "upload.h"
+#include "form.h"
+
+//State for a single transfer driven from the Lua thread (sync requests, sessions, multi requests)
+struct easyhttp_Transfer {
+    CURL *handle;
+    struct easyhttp_Options options;
+    struct easyhttp_Buffer *buffer;
+    struct easyhttp_Headers *headers;
+    FILE *file;
+    struct easyhttp_Upload upload;
+    curl_mime *form;
+    lua_State *L;
+
+    size_t received; //bytes of the body received so far
+    const char *error; //set when a callback aborts the transfer, more specific than curl's error
+
+    //`resume`: where the requested range starts, and whether the response has been checked to be that range
+    curl_off_t resume_from;
+    bool resume_checked, discard;
+    char *etag; //validator of what is already in the file, sent as If-Range
+    struct curl_slist *request_headers; //the request headers with If-Range added
+};
+
+//Sets up `handle` for `url` with the options in `transfer->options`, returns an error message on failure
+const char *easyhttp_transfer_setup(struct easyhttp_Transfer *transfer, lua_State *L, CURL *handle, const char *url);
+//Pushes `body, status_code, headers` for a completed transfer
+int easyhttp_transfer_push_response(struct easyhttp_Transfer *transfer);
+//Describes why the transfer failed with `result`
+const char *easyhttp_transfer_strerror(struct easyhttp_Transfer *transfer, CURLcode result);
+//Frees everything owned by the transfer except the curl handle
+void easyhttp_transfer_cleanup(struct easyhttp_Transfer *transfer);
+
+//Performs the transfer on `handle` and pushes its results, same return values as `easyhttp.request`
+int easyhttp_transfer_perform(lua_State *L, CURL *handle, const char *url, struct easyhttp_Options options);
+
+#endif //EASYHTTP_TRANSFER_H
@@ -0,0 +1,338 @@
+/**
+ * Copyright (c) 2024 Amrit Bhogal
+ *
+ * This software is released under the MIT License.
+ * https://opensource.org/licenses/MIT
+ */
+
+#include "upload.h"
+#include "file.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <curl/curl.h>
+#include <zlib.h>
+
+//plain data is read from the source in blocks of this size, and compressed into curl's upload buffer
+#define EASYHTTP_UPLOAD_COMPRESS_INPUT_SIZE ((size_t)64 * 1024)
+
+struct easyhttp_Compressor {
+    z_stream zlib;
+    //read from the source but not compressed yet
+    size_t input_start, input_length;
+    bool input_done, finished;
+    char input[];
+};
+
+static voidpf zlib_alloc(voidpf opaque, uInt items, uInt size)
+{
+    (void)opaque;
+    return easyhttp_malloc((size_t)items * size);
+}
+
+static void zlib_free(voidpf opaque, voidpf address)
+{
+    (void)opaque;
+    easyhttp_free(address);
+}
+
+//Reads the plain body, returns CURL_READFUNC_ABORT on failure
+static size_t source_read(struct easyhttp_Upload *upload, char *buf, size_t capacity)
+{
+    if (upload->file) {
+        size_t n = fread(buf, 1, capacity, upload->file);
+        if (n == 0 && ferror(upload->file)) {
+            snprintf(upload->error, sizeof(upload->error), "failed to read body: %s", strerror(errno));
+            return CURL_READFUNC_ABORT;
+        }
+        return n;
+    }
+
+    if (upload->memory) {
+        size_t n = upload->memory_length - upload->memory_offset;
+        if (n > capacity) n = capacity;
+        memcpy(buf, upload->memory + upload->memory_offset, n);
+        upload->memory_offset += n;
+        return n;
+    }
+
+    lua_State *L = upload->L;
+    if (upload->pending_length == 0) {
+        luaL_unref(L, LUA_REGISTRYINDEX, upload->chunk);
+        upload->chunk = LUA_NOREF;
+
+        //the reader is asked for at most as much as curl can take, but longer strings are fine
+        lua_rawgeti(L, LUA_REGISTRYINDEX, upload->reader);
+        lua_pushinteger(L, (lua_Integer)capacity);
+        if (lua_pcall(L, 1, 1, 0) != LUA_OK) {
+            snprintf(upload->error, sizeof(upload->error), "body reader failed: %s", lua_tostring(L, -1));
+            lua_pop(L, 1);
+            return CURL_READFUNC_ABORT;
+        }
+
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 1);
+            return 0;
+        }
+        if (lua_type(L, -1) != LUA_TSTRING) {
+            snprintf(upload->error, sizeof(upload->error), "body reader must return a string or nil, got %s", luaL_typename(L, -1));
+            lua_pop(L, 1);
+            return CURL_READFUNC_ABORT;
+        }
+
+        upload->pending = lua_tolstring(L, -1, &upload->pending_length);
+        upload->chunk = luaL_ref(L, LUA_REGISTRYINDEX);
+        if (upload->pending_length == 0)
+            return 0;
+    }
+
+    size_t n = upload->pending_length < capacity ? upload->pending_length : capacity;
+    memcpy(buf, upload->pending, n);
+    upload->pending += n;
+    upload->pending_length -= n;
+    return n;
+}
+
+static bool source_rewind(struct easyhttp_Upload *upload)
+{
+    if (upload->file)
+        return upload->start >= 0 && easyhttp_file_seek(upload->file, upload->start, SEEK_SET) == 0;
+    if (upload->memory) {
+        upload->memory_offset = 0;
+        return true;
+    }
+    return false;
+}
+
+static const char *compressor_create(struct easyhttp_Upload *upload)
+{
+    struct easyhttp_Compressor *compressor = easyhttp_malloc(sizeof(struct easyhttp_Compressor) + EASYHTTP_UPLOAD_COMPRESS_INPUT_SIZE);
+    if (!compressor)
+        return "failed to allocate memory for the body compressor";
+    *compressor = (struct easyhttp_Compressor) {
+        .zlib = { .zalloc = zlib_alloc, .zfree = zlib_free },
+    };
+
+    switch (upload->compression) {
+        case EASYHTTP_COMPRESSION_GZIP:
+            //15 window bits + 16 writes a gzip header and trailer instead of a zlib one
+            if (deflateInit2(&compressor->zlib, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                easyhttp_free(compressor);
+                return "failed to initialise gzip";
+            }
+            break;
+        default:
+            easyhttp_free(compressor);
+            return "unsupported body compression";
+    }
+
+    upload->compressor = compressor;
+    return NULL;
+}
+
+static void compressor_reset(struct easyhttp_Upload *upload)
+{
+    struct easyhttp_Compressor *compressor = upload->compressor;
+    compressor->input_start = compressor->input_length = 0;
+    compressor->input_done = compressor->finished = false;
+
+    if (upload->compression == EASYHTTP_COMPRESSION_GZIP)
+        deflateReset(&compressor->zlib);
+}
+
+static void compressor_free(struct easyhttp_Upload *upload)
+{
+    struct easyhttp_Compressor *compressor = upload->compressor;
+    if (!compressor)
+        return;
+
+    if (upload->compression == EASYHTTP_COMPRESSION_GZIP)
+        deflateEnd(&compressor->zlib);
+    easyhttp_free(compressor);
+    upload->compressor = NULL;
+}
+
+//Fills `buf` with compressed data, only returns 0 once the compressed stream is complete
+static size_t compressed_read(struct easyhttp_Upload *upload, char *buf, size_t capacity)
+{
+    struct easyhttp_Compressor *compressor = upload->compressor;
+
+    size_t produced = 0;
+    while (produced == 0 && !compressor->finished) {
+        if (compressor->input_start == compressor->input_length && !compressor->input_done) {
+            size_t n = source_read(upload, compressor->input, EASYHTTP_UPLOAD_COMPRESS_INPUT_SIZE);
+            if (n == CURL_READFUNC_ABORT)
+                return n;
+            compressor->input_start = 0;
+            compressor->input_length = n;
+            compressor->input_done = n == 0;
+        }
+
+        size_t available = compressor->input_length - compressor->input_start, consumed = 0;
+        switch (upload->compression) {
+            case EASYHTTP_COMPRESSION_GZIP: {
+                z_stream *zlib = &compressor->zlib;
+                zlib->next_in = (Bytef *)compressor->input + compressor->input_start;
+                zlib->avail_in = (uInt)available;
+                zlib->next_out = (Bytef *)buf;
+                zlib->avail_out = (uInt)capacity;
+
+                //Z_BUF_ERROR only means nothing could be done with what was given, more input is read next time round
+                int res = deflate(zlib, compressor->input_done ? Z_FINISH : Z_NO_FLUSH);
+                if (res == Z_STREAM_ERROR) {
+                    snprintf(upload->error, sizeof(upload->error), "failed to compress body: %s", zlib->msg ? zlib->msg : "gzip error");
+                    return CURL_READFUNC_ABORT;
+                }
+                compressor->finished = res == Z_STREAM_END;
+                consumed = available - zlib->avail_in;
+                produced = capacity - zlib->avail_out;
+                break;
+            }
+            default:
+                return CURL_READFUNC_ABORT;
+        }
+        compressor->input_start += consumed;
+    }
+
+    return produced;
+}
+
+static size_t read_callback(char *buf, size_t size, size_t nitems, void *userp)
+{
+    struct easyhttp_Upload *upload = userp;
+    if (upload->compressor)
+        return compressed_read(upload, buf, size * nitems);
+    return source_read(upload, buf, size * nitems);
+}
+
+static int seek_callback(void *userp, curl_off_t offset, int origin)
+{
+    struct easyhttp_Upload *upload = userp;
+    //curl only ever rewinds to the start of the body
+    if (origin != SEEK_SET)
+        return CURL_SEEKFUNC_CANTSEEK;
+
+    if (upload->compressor) {
+        //the offset is into the compressed stream, which can only be started over
+        if (offset != 0 || !source_rewind(upload))
+            return CURL_SEEKFUNC_CANTSEEK;
+        compressor_reset(upload);
+        return CURL_SEEKFUNC_OK;
+    }
+
+    if (!upload->file || upload->start < 0)
+        return CURL_SEEKFUNC_CANTSEEK;
+    return easyhttp_file_seek(upload->file, upload->start + offset, SEEK_SET) == 0 ? CURL_SEEKFUNC_OK : CURL_SEEKFUNC_FAIL;
+}
+
+//The headers curl would send, plus the Content-Encoding of the compressed body unless it was set by hand
+static const char *set_encoding_header(struct easyhttp_Upload *upload, const struct easyhttp_Options *options, CURL *handle)
+{
+    const struct easyhttp_Options *defaults = options->defaults ? options->defaults : &EASYHTTP_DEFAULT_OPTIONS;
+    bool found = false;
+    for (struct curl_slist *it = options->headers ? options->headers : defaults->headers; it; it = it->next) {
+        if (curl_strnequal(it->data, "Content-Encoding:", sizeof("Content-Encoding:") - 1))
+            found = true;
+        struct curl_slist *headers = curl_slist_append(upload->headers, it->data);
+        if (!headers)
+            return "failed to allocate memory for headers";
+        upload->headers = headers;
+    }
+
+    if (!found) {
+        struct curl_slist *headers = curl_slist_append(upload->headers, "Content-Encoding: gzip");
+        if (!headers)
+            return "failed to allocate memory for headers";
+        upload->headers = headers;
+    }
+
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, upload->headers);
+    return NULL;
+}
+
+const char *easyhttp_upload_setup(struct easyhttp_Upload *upload, const struct easyhttp_Options *options, lua_State *L, CURL *handle)
+{
+    *upload = (struct easyhttp_Upload) {
+        .start = -1,
+        .L = L,
+        .reader = LUA_NOREF,
+        .chunk = LUA_NOREF,
+        .compression = options->compress_body,
+    };
+
+    curl_off_t length = options->body_length;
+    if (options->body_file) {
+        upload->file = fopen(options->body_file, "rb");
+        if (!upload->file)
+            return "failed to open body_file";
+        upload->owned = true;
+    } else if (options->body_stream) {
+        upload->file = *options->body_stream;
+        if (!upload->file)
+            return "body file is closed";
+    } else if (options->body_reader != LUA_NOREF) {
+        if (!L)
+            return "body functions are not supported for async requests, use a string or a file";
+        upload->reader = options->body_reader;
+    } else if (options->body && upload->compression != EASYHTTP_COMPRESSION_NONE) {
+        upload->memory = options->body;
+        upload->memory_length = (size_t)options->body_length;
+    } else {
+        return NULL;
+    }
+
+    if (upload->file) {
+        //the rest of the file is sent, unless told otherwise. Pipes and the like can't tell and are sent chunked
+        upload->start = easyhttp_file_tell(upload->file);
+        if (upload->start >= 0 && length < 0 && easyhttp_file_seek(upload->file, 0, SEEK_END) == 0) {
+            curl_off_t end = easyhttp_file_tell(upload->file);
+            if (end >= upload->start)
+                length = end - upload->start;
+            easyhttp_file_seek(upload->file, upload->start, SEEK_SET);
+        }
+    }
+
+    if (upload->compression != EASYHTTP_COMPRESSION_NONE) {
+        const char *err = compressor_create(upload);
+        if (!err)
+            err = set_encoding_header(upload, options, handle);
+        if (err)
+            return err;
+        //the compressed size is only known once it has been sent
+        length = -1;
+    }
+
+    curl_easy_setopt(handle, CURLOPT_POST, 1L);
+    curl_easy_setopt(handle, CURLOPT_READFUNCTION, read_callback);
+    curl_easy_setopt(handle, CURLOPT_READDATA, upload);
+    curl_easy_setopt(handle, CURLOPT_SEEKFUNCTION, seek_callback);
+    curl_easy_setopt(handle, CURLOPT_SEEKDATA, upload);
+    //-1 has curl send the body chunked
+    curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE_LARGE, length);
+    return NULL;
+}
+
+const char *easyhttp_upload_error(const struct easyhttp_Upload *upload)
+{
+    return upload->error[0] ? upload->error : NULL;
+}
+
+void easyhttp_upload_cleanup(struct easyhttp_Upload *upload)
+{
+    if (upload->owned && upload->file)
+        fclose(upload->file);
+    upload->file = NULL;
+    upload->owned = false;
+
+    if (upload->L)
+        luaL_unref(upload->L, LUA_REGISTRYINDEX, upload->chunk);
+    upload->chunk = LUA_NOREF;
+    upload->pending = NULL;
+    upload->pending_length = 0;
+
+    compressor_free(upload);
+    curl_slist_free_all(upload->headers);
+    upload->headers = NULL;
+}
@@ -0,0 +1,46 @@
+// Copyright (c) 2024 Amrit Bhogal
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef EASYHTTP_UPLOAD_H
+#define EASYHTTP_UPLOAD_H
+
+#include "common.h"
+
+#include <stdio.h>
+
+struct easyhttp_Compressor;
+
+//Streams a request body which isn't a string (`body_file`, a FILE* or a reader function) through CURLOPT_READFUNCTION,
+//or any body which is compressed on the way out
+struct easyhttp_Upload {
+    FILE *file;
+    bool owned; //`file` was opened for `body_file` and is closed with the upload
+    curl_off_t start; //position the body starts at in `file`, so curl can rewind it (e.g. on redirects), -1 if it can't seek
+
+    lua_State *L; //NULL when the transfer isn't driven from the Lua thread, reader functions need it
+    LuaReference_t reader;
+    //what is left of the last string returned by the reader, anchored by `chunk` until it is used up
+    LuaReference_t chunk;
+    const char *pending;
+    size_t pending_length;
+    //string bodies only come through here to be compressed
+    const char *memory;
+    size_t memory_length, memory_offset;
+
+    enum easyhttp_Compression compression;
+    struct easyhttp_Compressor *compressor;
+    struct curl_slist *headers; //the request headers with Content-Encoding added
+
+    char error[256]; //set when reading the body aborts the transfer
+};
+
+//Sets up `handle` to upload the streamed body in `options`, if any. Returns an error message on failure.
+//`upload` must not move until it is cleaned up, curl keeps a pointer to it
+const char *easyhttp_upload_setup(struct easyhttp_Upload *upload, const struct easyhttp_Options *options, lua_State *L, CURL *handle);
+//Why reading the body aborted the transfer, NULL if it didn't
+const char *easyhttp_upload_error(const struct easyhttp_Upload *upload);
+void easyhttp_upload_cleanup(struct easyhttp_Upload *upload);
+
+#endif //EASYHTTP_UPLOAD_H
@@ -13,33 +13,137 @@ local easyhttp = {}
 ---| '"HEAD"'
 ---| '"OPTIONS"'
 
+---@alias easyhttp.HTTPVersion
+---| '"1.0"'
+---| '"1.1"'
+---| '"2"' # HTTP/2 over TLS, HTTP/1.1 for plain http
+---| '"2-prior-knowledge"' # HTTP/2 without an upgrade, the server must support it
+
+---@alias easyhttp.ResponseBody
+---| '"string"' # the default
+---| '"bytes"' # an `easyhttp.Bytes`, which keeps the body in native memory instead of copying it into a string
+
+---A response body kept in native memory, only the parts which are asked for are copied into Lua strings.
+---@class easyhttp.Bytes
+---@operator len: integer
+local Bytes = {}
+
+---@return integer
+function Bytes:len() end
+
+---Same as `string.sub`.
+---@param i integer
+---@param j integer?
+---@return string
+function Bytes:sub(i, j) end
+
+---Finds `needle` as plain text (not a pattern), same return values as `string.find`.
+---@param needle string
+---@param init integer?
+---@return integer? start, integer? end
+function Bytes:find(needle, init) end
+
+---Copies the whole body into a string.
+---@return string
+function Bytes:tostring() end
+
+---Writes the body to `file` without copying it into a string.
+---@param file file*
+---@return true? ok, string? error
+function Bytes:write(file) end
+
+---@alias easyhttp.ResponseHeaders
+---| '"table"' # the default
+---| '"object"' # an `easyhttp.Headers`, which only creates strings for the headers which are read
+
+---Response headers, indexing it looks a header up case-insensitively, e.g. `headers["content-type"]`.
+---If a header shares its name with a method, use `:get`.
+---@class easyhttp.Headers
+---@field [string] string?
+---@operator len: integer
+local Headers = {}
+
+---Gets the value of the last header called `name`, ignoring case.
+---@param name string
+---@return string?
+function Headers:get(name) end
+
+---Gets the values of every header called `name` (e.g. Set-Cookie), in the order they were received.
+---@param name string
+---@return string[]
+function Headers:get_all(name) end
+
+---Iterates over every header in the order they were received, repeated headers are visited once for each value.
+---@return fun(): string?, string?
+function Headers:pairs() end
+
+---Returns the next piece of a streamed request body, `nil` or `""` once it is done.
+---Only supported for requests driven from Lua, not `easyhttp.async_request`
+---@alias easyhttp.BodyReader fun(max_bytes: integer): string?
+
+---A multipart form part. `path` is streamed from disk and named after its basename unless `filename` is given
+---@class easyhttp.FormPart
+---@field name string? required for parts in the list part of the form
+---@field data string?
+---@field path string?
+---@field type string? content type of the part
+---@field filename string?
+
 ---@class easyhttp.RequestOptions
 ---@field method easyhttp.HTTPMethod?
 ---@field headers { [string] : string }?
----@field body string?
+---@field body (string | easyhttp.Bytes | file* | easyhttp.BodyReader)? strings and bytes are sent without copying, a file is sent from its current position, a function is called for each piece of the body
+---@field body_file string? path of a file to send as the body, it is streamed rather than loaded into memory
+---@field compress_body "gzip"? compresses the body while it is sent, and sets `Content-Encoding`
+---@field form { [string | integer] : string | easyhttp.FormPart }? sent as multipart/form-data, can't be combined with `body`
+---@field body_length integer? size of a streamed body, sent chunked when it isn't known. Files are measured when possible
 ---@field timeout number?
 ---@field follow_redirects boolean?
 ---@field max_redirects number?
+---@field http_version easyhttp.HTTPVersion? with HTTP/2, concurrent requests to the same host share one connection
+---@field resolve { [string] : string | string[] }? pins `"host:port"` to addresses, skipping DNS. The pins are added to the shared DNS cache
+---@field connect_to { [string] : string }? connects to another `"host:port"` instead of the one in the url
+---@field dns_cache_timeout integer? seconds DNS answers are cached for, 60 by default, -1 caches them forever
+---@field expected_size integer? bytes to allocate for the body up front, when the server doesn't send a Content-Length
+---@field max_buffered_bytes integer? async only, the transfer is paused while this many bytes are waiting to be read with `AsyncRequest:read`. `AsyncRequest:response` lifts the limit
+---@field max_response_size integer? the request fails once the body is larger than this
+---@field compressed (boolean | string)? asks for compressed responses and decodes them, `true` for every encoding curl supports or a list such as `"gzip,br,zstd"`
+---@field response_body easyhttp.ResponseBody?
+---@field response_headers easyhttp.ResponseHeaders?
 ---@field output_file file*?
----@field on_progress (fun(dltotal: number, dlnow: number, ultotal: number, ulnow: number): number?)?
+---@field resume (boolean | string)? continues `output_file` from its end instead of starting over, a string is the ETag of what it holds
+---@field retries integer? times a resumed download is retried after a transient error, 3 by default. The backoff between attempts (0.5 to 8 seconds) blocks, and is capped by `timeout`
+---@field on_progress (fun(dltotal: number, dlnow: number, ultotal: number, ulnow: number, received: integer): number?)? `dlnow` counts bytes on the wire, `received` the decoded body
 ---@field on_data (fun(data: string, size: integer, nmemb: integer): string | false | nil)?
 
 
 ---Sends a synchronous HTTP request, blocking the current thread until the request is complete.
 ---@param url string
 ---@param options easyhttp.RequestOptions?
----@return (string | true)? body, integer | string? code, { [string] : string }? headers
+---@return (string | easyhttp.Bytes | true)? body, integer | string? code, ({ [string] : string } | easyhttp.Headers)? headers
 function easyhttp.request(url, options) end
 
+---@class easyhttp.DownloadOptions : easyhttp.RequestOptions
+---@field parts integer? most ranges fetched in parallel, 4 by default. Each one is at least `min_part_size`
+---@field min_part_size integer? smallest range worth its own connection, 1 MiB by default
+
+---Downloads `url` into the file at `path`, in parallel ranges when the server supports them.
+---@param url string
+---@param path string
+---@param options easyhttp.DownloadOptions?
+---@return true? ok, integer | string? code, { [string] : string }? headers, integer? parts how many ranges the file was fetched in, 1 for a single stream
+function easyhttp.download(url, path, options) end
+
 ---@class easyhttp.AsyncRequest
 local AsyncRequest = {}
 
----Returns true if the request is complete, false otherwise.
+---Returns true if the request is complete (successfully, with an error or cancelled), false otherwise.
 ---@return boolean
 function AsyncRequest:is_done() end
 
 ---Gets the response, same return values as easyhttp.request.
----@return string? body, integer | string? code, { [string] : string }? headers
+---With `response_body = "bytes"` the body is handed to the returned value, after which `:data()` and `:read()` no longer return it.
+---@return (string | easyhttp.Bytes)? body, integer | string? code, ({ [string] : string } | easyhttp.Headers)? headers
 function AsyncRequest:response() end
 
 ---Cancels the request, returns true if the request was successfully cancelled, false otherwise, and why it was not cancelled.
@@ -47,17 +151,104 @@ function AsyncRequest:response() end
 function AsyncRequest:cancel() end
 
 ---Gets the progress of the request
----@return number dltotal, number dlnow, number ultotal, number ulnow
+---@return number dlnow, number dltotal, number ulnow, number ultotal, integer received bytes of the body received so far, after decoding
 function AsyncRequest:progress() end
 
 ---Gets the data of the request (if any). This call does not block, so if it is called before `:is_done()` the data will likley be incomplete.
 ---@return string? data, integer? size
 function AsyncRequest:data() end
 
+---Reads the data received since the last call and removes it from the request, without blocking.
+---Returns `""` if nothing new has arrived yet, `nil` once everything was read, or `nil, error` if the request failed.
+---Data which was read is no longer returned by `:data()` or `:response()`.
+---@param max_bytes integer? at most this many bytes are returned, all of them if not given
+---@return string? data, string? error
+function AsyncRequest:read(max_bytes) end
+
 ---Sends an asynchronous HTTP request, returning an AsyncRequest object.
+---All async requests are driven by a single background thread, which is started by the first request.
 ---@param url string
 ---@param options easyhttp.RequestOptions?
 ---@return easyhttp.AsyncRequest? request, string? error
 function easyhttp.async_request(url, options) end
 
+---@class easyhttp.Config
+---@field max_concurrency integer? maximum number of async requests running at once, the rest wait in a queue (0 = unlimited)
+---@field max_per_host integer? maximum number of connections to a single host (0 = unlimited)
+---@field max_concurrent_streams integer? maximum number of HTTP/2 streams multiplexed over one connection (0 = curl's default)
+---@field memory_limit integer? bytes easyhttp may have allocated at once, allocations over it fail (0 = unlimited)
+---@field memory_stats boolean? counts the usage, peak, allocations and requests for `easyhttp.memory_stats`, off by default
+---@field count_libcurl boolean? counts (and limits) libcurl's allocations too, raises an error after the first request
+
+---Changes process-wide settings, fields which are not given keep their current value.
+---@param options easyhttp.Config
+function easyhttp.configure(options) end
+
+---@class easyhttp.MemoryStats
+---@field current integer bytes currently allocated by easyhttp (and libcurl, with `count_libcurl`)
+---@field peak integer most bytes allocated at once
+---@field allocations integer
+---@field allocated integer bytes of all allocations, including the ones which were freed since
+---@field failed integer allocations refused because of `memory_limit`
+---@field requests integer
+---@field allocations_per_request number
+---@field bytes_per_request number
+---@field limit integer
+---@field accounting boolean whether `memory_stats` or `memory_limit` is on, without either nothing is counted
+
+---Gets the memory used by easyhttp, counted while `accounting` is on. This does not include Lua values, e.g. the strings responses are returned as.
+---@param reset boolean? resets the peak to the current usage, and the counters to 0, after reading them
+---@return easyhttp.MemoryStats
+function easyhttp.memory_stats(reset) end
+
+---Resolves and connects to the given urls in parallel, filling the DNS and TLS session caches shared by all requests.
+---@param urls string[]
+---@param timeout integer? in seconds, 10 by default
+---@return integer connected number of urls which were connected to
+function easyhttp.preconnect(urls, timeout) end
+
+---@class easyhttp.Session
+local Session = {}
+
+---Sends a synchronous HTTP request using the session's defaults, reusing its handles and connections.
+---Options given here are applied on top of the defaults, headers are sent alongside the default ones.
+---@param url string
+---@param options easyhttp.RequestOptions?
+---@return (string | easyhttp.Bytes | true)? body, integer | string? code, ({ [string] : string } | easyhttp.Headers)? headers
+function Session:request(url, options) end
+
+---Opens connections to the given urls in parallel (with a `HEAD` request), so the session's next requests to them can skip the handshakes.
+---@param urls string[]
+---@param timeout integer? in seconds, defaults to the session's timeout
+---@return integer connected number of urls which were connected to
+function Session:warm(urls, timeout) end
+
+---Creates a session, which keeps connections (and TLS sessions) alive between requests to the same host.
+---@param defaults easyhttp.RequestOptions? options applied to every request made with this session
+---@return easyhttp.Session? session, string? error
+function easyhttp.session(defaults) end
+
+---@class easyhttp.MultiRequestOptions : easyhttp.RequestOptions
+---@field on_finish (fun(body: string | easyhttp.Bytes | true, code: integer, headers: { [string] : string } | easyhttp.Headers))?
+---@field on_error (fun(error: string))?
+
+---@class easyhttp.MultiRequest
+---@operator len: integer
+local MultiRequest = {}
+
+---Drives all of the transfers on the calling thread, calling `on_finish` or `on_error` as each one completes.
+---Blocks until every transfer is done, or for at most `timeout` seconds if given.
+---@param timeout number?
+---@return integer? running number of transfers still in progress, string? error
+function MultiRequest:perform(timeout) end
+
+---Gets the number of transfers which have completed, successfully or not.
+---@return integer
+function MultiRequest:completed_requests() end
+
+---Creates a set of requests which are all driven together by `MultiRequest:perform`, on a single thread.
+---@param requests { [string] : easyhttp.MultiRequestOptions } the options for each url
+---@return easyhttp.MultiRequest? request, string? error
+function easyhttp.multi_request(requests) end
+
 return easyhttp